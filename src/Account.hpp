@@ -7,6 +7,7 @@
 #include "Error.hpp"
 #include "Utils.hpp"
 #include "PersistentSet.hpp"
+#include "PersistentHash.hpp"
 
 struct Account {
   String30 userID;
@@ -43,10 +44,10 @@ struct Account {
 };
 
 namespace Accounts {
-  PersistentMap<String30, Account, 450> accountMap(false, "accounts");
+  PersistentHashMap<String30, Account, 64, 640> accountMap("accounts.hash"); //filtered as register and useradd look up free IDs
 
   bool add(const Account &account) {
-    return accountMap.put(account.userID, account);
+    return accountMap.insertIfAbsent(account.userID, account);
   }
 
   Account get(const String30 &userID) {
@@ -62,20 +63,33 @@ namespace Accounts {
   }
 
   bool modify(const String30 &userID, const String30 &password) {
-    Account account = get(userID);
-    if (account.empty()) {
-      return false;
-    }
-    account.password = password;
-    accountMap.remove(userID);
-    return accountMap.put(userID, account);
+    return accountMap.update(userID, [&password](Account &account) {
+      account.password = password;
+    });
   }
 
   bool remove(const String30 &userID) {
     return accountMap.remove(userID);
   }
 
+  void compact() { //compact the map and print the bytes reclaimed
+    std::cout << "accounts\t" << accountMap.compact() << '\n';
+  }
+
+  void stats() { //print the depth and the number of buckets of the hash table and the statistics of its bloom filters
+    std::cout << "accounts\t" << accountMap.depth() << '\t' << accountMap.buckets() << '\t' << accountMap.stats() << '\n';
+  }
+
   void init() {
+    if (std::filesystem::exists("storage/accounts.dat")) { //move accounts from the ordered map used before
+      {
+        PersistentMap<String30, Account, 450> old(false, "accounts");
+        old.iterateAll(String30::min(), String30::max(), [](const Account &account) {
+          add(account);
+        }, []() {});
+      }
+      std::filesystem::remove("storage/accounts.dat");
+    }
     add(Account{String30{"root"}, String30{"sjtu"}, String30{"root"}, ADMIN}); //try to store root if not exists
   }
 }
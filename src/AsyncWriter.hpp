@@ -0,0 +1,74 @@
+//
+// Created by zjx on 2024/1/16.
+//
+
+#ifndef BOOKSTORE_ASYNC_WRITER_HPP
+#define BOOKSTORE_ASYNC_WRITER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <utility>
+
+template<class T, int CAPACITY>
+class AsyncWriter {
+  //hand events from a single producer to a background thread through a bounded lock-free ring
+  //the thread consumes all events available at once, so writes are done in batches
+  T ring[CAPACITY];
+  static constexpr uint64_t STOP = uint64_t(1) << 63; //set in tail when the thread should stop once idle
+  std::atomic<uint64_t> tail{0}; //number of events pushed, only written by the producer
+  std::atomic<uint64_t> head{0}; //number of events consumed, only written by the thread
+  std::function<void(T &)> consume;
+  std::thread thread;
+
+  void run() {
+    uint64_t done = 0;
+    while (true) {
+      uint64_t t = tail.load(std::memory_order_acquire), end = t & ~STOP;
+      if (end == done) {
+        if (t & STOP) {
+          return;
+        }
+        tail.wait(t, std::memory_order_acquire);
+        continue;
+      }
+      for (; done < end; done++) {
+        consume(ring[done % CAPACITY]);
+      }
+      head.store(done, std::memory_order_release);
+      head.notify_all();
+    }
+  }
+
+public:
+  explicit AsyncWriter(std::function<void(T &)> consume) : consume(std::move(consume)) {
+    thread = std::thread(&AsyncWriter::run, this);
+  }
+
+  ~AsyncWriter() {
+    flush();
+    tail.fetch_or(STOP, std::memory_order_release);
+    tail.notify_all();
+    thread.join();
+  }
+
+  void push(T &&t) { //wait if the ring is full
+    uint64_t end = tail.load(std::memory_order_relaxed);
+    for (uint64_t start; end - (start = head.load(std::memory_order_acquire)) == CAPACITY;) {
+      head.wait(start, std::memory_order_acquire);
+    }
+    ring[end % CAPACITY] = std::move(t);
+    tail.store(end + 1, std::memory_order_release);
+    tail.notify_one();
+  }
+
+  void flush() { //wait until all pushed events are consumed. the thread stays idle until the next push
+    uint64_t end = tail.load(std::memory_order_relaxed);
+    for (uint64_t start; (start = head.load(std::memory_order_acquire)) != end;) {
+      head.wait(start, std::memory_order_acquire);
+    }
+  }
+};
+
+#endif //BOOKSTORE_ASYNC_WRITER_HPP
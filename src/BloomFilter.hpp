@@ -0,0 +1,92 @@
+//
+// Created by zjx on 2024/1/12.
+//
+
+#ifndef BOOKSTORE_BLOOM_FILTER_HPP
+#define BOOKSTORE_BLOOM_FILTER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <utility>
+
+template<class T>
+uint64_t bloomHash(const T &t) { //use hash() of the class if provided
+  if constexpr (requires { t.hash(); }) {
+    return t.hash();
+  } else {
+    return std::hash<T>()(t);
+  }
+}
+
+template<class K, class V>
+uint64_t bloomHash(const std::pair<K, V> &p) { //only the key matters in a map
+  return bloomHash(p.first);
+}
+
+inline uint64_t mixHash(uint64_t h) { //spread bits of a weak hash such as std::hash<int>
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  return h;
+}
+
+template<int BITS>
+struct BloomFilter { //a bloom filter of BITS bits. never gives false negative
+  static constexpr int K = 6; //number of hash functions, about the best for 10 bits per element
+  uint64_t bits[BITS / 64];
+
+  void clear() {
+    std::memset(bits, 0, sizeof(bits));
+  }
+
+  void add(uint64_t hash) {
+    hash = mixHash(hash);
+    uint64_t h1 = hash & 0xFFFFFFFF, h2 = hash >> 32 | 1; //double hashing
+    for (int i = 0; i < K; i++) {
+      uint64_t bit = (h1 + i * h2) % BITS;
+      bits[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+  }
+
+  [[nodiscard]] bool mayContain(uint64_t hash) const {
+    hash = mixHash(hash);
+    uint64_t h1 = hash & 0xFFFFFFFF, h2 = hash >> 32 | 1;
+    for (int i = 0; i < K; i++) {
+      uint64_t bit = (h1 + i * h2) % BITS;
+      if (!(bits[bit / 64] >> (bit % 64) & 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+template<>
+struct BloomFilter<0> { //disabled
+  void clear() {}
+
+  void add(uint64_t) {}
+
+  [[nodiscard]] bool mayContain(uint64_t) const {
+    return true;
+  }
+};
+
+struct BloomStats {
+  long long checks = 0; //lookups consulting a filter
+  long long negatives = 0; //lookups answered by a filter without reading the leaf
+  long long falsePositives = 0; //lookups passing a filter but not found in the leaf
+
+  [[nodiscard]] double falsePositiveRate() const {
+    return negatives + falsePositives == 0 ? 0 : static_cast<double>(falsePositives) / (negatives + falsePositives);
+  }
+
+  friend std::ostream &operator<<(std::ostream &out, const BloomStats &stats) {
+    return out << stats.checks << '\t' << stats.negatives << '\t' << stats.falsePositives << '\t'
+               << stats.falsePositiveRate();
+  }
+};
+
+#endif //BOOKSTORE_BLOOM_FILTER_HPP
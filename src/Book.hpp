@@ -7,6 +7,7 @@
 
 #include "Utils.hpp"
 #include "PersistentSet.hpp"
+#include "PersistentHash.hpp"
 #include <iostream>
 #include <iomanip>
 
@@ -15,7 +16,7 @@ struct Book {
   String60 name;
   String60 author;
   String60 keyword; //full keywords
-  Double price;
+  Money price;
   int stock;
 
   auto operator<=>(const Book &rhs) const {
@@ -44,50 +45,438 @@ struct Book {
   }
 };
 
+struct LegacyBook { //a book record written before prices were kept in cents
+  String20 isbn;
+  String60 name;
+  String60 author;
+  String60 keyword;
+  LegacyMoney price;
+  int stock;
+
+  auto operator<=>(const LegacyBook &rhs) const {
+    return isbn <=> rhs.isbn;
+  }
+
+  bool operator==(const LegacyBook &rhs) const {
+    return isbn == rhs.isbn;
+  }
+
+  [[nodiscard]] Book get() const {
+    return Book{isbn, name, author, keyword, price.get(), stock};
+  }
+
+  static constexpr LegacyBook min() {
+    return LegacyBook{String20::min()};
+  }
+
+  static constexpr LegacyBook max() {
+    return LegacyBook{String20::max()};
+  }
+};
+
+struct BookRef { //refer to a book record in the heap. ordered by ISBN so that indexes list books in order
+  String20 isbn;
+  int pos;
+
+  auto operator<=>(const BookRef &rhs) const {
+    return isbn <=> rhs.isbn;
+  }
+
+  bool operator==(const BookRef &rhs) const {
+    return isbn == rhs.isbn;
+  }
+
+  [[nodiscard]] bool empty() const {
+    return isbn.empty();
+  }
+
+  static constexpr BookRef min() {
+    return BookRef{String20::min(), -1};
+  }
+
+  static constexpr BookRef max() {
+    return BookRef{String20::max(), -1};
+  }
+};
+
 namespace Books {
   template<typename T>
-  using BookMap = PersistentMap<T, Book, 450>;
-  BookMap<String20> isbnMap(false, "isbn");
+  using BookMap = PersistentMap<T, BookRef, 450>;
+
+  bool upgrade() { //move aside the maps storing full books, which were used before the book heap
+    if (!std::filesystem::exists("storage/isbn.dat") || std::filesystem::exists("storage/book.dat")) {
+      return false;
+    }
+    for (const char *name: {"isbn", "name", "author", "keyword"}) {
+      std::filesystem::rename(string("storage/") + name + ".dat", string("storage/") + name + ".old.dat");
+    }
+    return true;
+  }
+
+  bool upgrading = upgrade();
+  bool hashing = !std::filesystem::exists("storage/isbn.hash.dat"); //the hash index is built from isbnMap if missing
+  Storage<Book, int> bookHeap("book"); //all the books. indexes refer to them by position
+  PersistentHashMap<String20, BookRef, 128, 1280> isbnHash("isbn.hash"); //for lookups by ISBN, filtered as most from select miss
+  BookMap<String20> isbnMap(false, "isbn"); //only for listing in the order of ISBN
   BookMap<String60> nameMap(true, "name");
   BookMap<String60> authorMap(true, "author");
   BookMap<String60> keywordMap(true, "keyword"); //key for each keyword
+  bool pricing = !std::filesystem::exists("storage/price.dat"); //the price index is built from the books if missing
+  BookMap<Money> priceMap(true, "price");
+
+  typedef FixedString<4> Gram; //a field tag followed by three consecutive characters
+  constexpr char NAME_FIELD = 'n';
+  constexpr char AUTHOR_FIELD = 'a';
+  constexpr int SEARCH_LIMIT = 100; //max books listed by a substring search
+  bool indexing = !std::filesystem::exists("storage/gram.dat"); //the trigram index is built from the books if missing
+  BookMap<Gram> gramMap(true, "gram"); //trigram index for substring search of name and author
+
+  struct Grams { //distinct trigrams of a field, sorted and kept inline
+    Gram data[60 - 2];
+    int size = 0;
+
+    [[nodiscard]] const Gram *begin() const {
+      return data;
+    }
+
+    [[nodiscard]] const Gram *end() const {
+      return data + size;
+    }
+
+    [[nodiscard]] bool empty() const {
+      return size == 0;
+    }
 
-  void store(const Book &book) { //store the book into the maps. no empty book allowed
+    [[nodiscard]] bool contains(const Gram &g) const {
+      return std::binary_search(begin(), end(), g);
+    }
+  };
+
+  Grams grams(char field, const String60 &s) { //distinct trigrams of s
+    Grams ret;
+    const char *begin = s.begin();
+    for (int i = 0; i + 3 <= s.len(); i++) {
+      char gram[4] = {field, begin[i], begin[i + 1], begin[i + 2]};
+      ret.data[ret.size++] = Gram(std::string_view(gram, 4));
+    }
+    std::sort(ret.data, ret.data + ret.size);
+    ret.size = static_cast<int>(std::unique(ret.data, ret.data + ret.size) - ret.data);
+    return ret;
+  }
+
+  //index the trigrams of a field changed from old to now. only changed ones are touched unless the ref has moved
+  void updateGrams(char field, const String60 &old, const String60 &now, const BookRef &oldRef, const BookRef &ref) {
+    bool moved = oldRef.isbn != ref.isbn;
+    Grams oldGrams = grams(field, old), newGrams = grams(field, now);
+    for (const Gram &g: oldGrams) {
+      if (moved || !newGrams.contains(g)) {
+        gramMap.remove(g, oldRef);
+      }
+    }
+    for (const Gram &g: newGrams) {
+      if (moved || !oldGrams.contains(g)) {
+        gramMap.put(g, ref);
+      }
+    }
+  }
+
+  bool store(const Book &book) { //store a new book into the heap and the indexes if its ISBN doesn't exist. return whether stored
     if (book.empty()) {
       throw Error("Empty book!");
     }
-    isbnMap.put(book.isbn, book);
-    nameMap.put(book.name, book);
-    authorMap.put(book.author, book);
-    for (const String60 &kw: book.keyword.split()) {
-      keywordMap.put(kw, book);
+    int pos = -1;
+    if (!isbnHash.insertIfAbsent(book.isbn, [&book, &pos]() { //the record is only added if absent
+      pos = bookHeap.add(book);
+      return BookRef{book.isbn, pos};
+    })) {
+      return false;
+    }
+    BookRef ref{book.isbn, pos};
+    isbnMap.put(book.isbn, ref);
+    nameMap.put(book.name, ref);
+    authorMap.put(book.author, ref);
+    priceMap.put(book.price, ref);
+    updateGrams(NAME_FIELD, String60{}, book.name, ref, ref);
+    updateGrams(AUTHOR_FIELD, String60{}, book.author, ref, ref);
+    for (std::string_view kw: book.keyword.split()) {
+      keywordMap.put(String60(kw), ref);
+    }
+    return true;
+  }
+
+  bool exists(const String20 &isbn) {
+    return !isbnHash.get(isbn).empty();
+  }
+
+  Book get(const String20 &isbn) { //return min() if not found
+    BookRef ref = isbnHash.get(isbn);
+    return ref.empty() ? Book::min() : bookHeap.get(ref.pos);
+  }
+
+  template<typename T>
+  void print(BookMap<T> &map, const T &k1, const T &k2) { //print books whose key is in [k1, k2]
+    map.iterateAll(k1, k2, [](const BookRef &ref) {
+      std::cout << bookHeap.get(ref.pos) << '\n';
+    }, []() {
+      std::cout << '\n';
+    });
+  }
+
+  void print(const String20 &isbn) { //print the book with the ISBN
+    Book book = get(isbn);
+    if (book.empty()) {
+      std::cout << '\n';
+    } else {
+      std::cout << book << '\n';
+    }
+  }
+
+  template<typename T>
+  long long count(BookMap<T> &map, const T &k1, const T &k2) { //count books whose key is in [k1, k2] without reading them
+    long long ret = 0;
+    for ([[maybe_unused]] const std::pair<T, BookRef> &p: map.range({k1, BookRef::min()}, {k2, BookRef::max()})) {
+      ret++;
+    }
+    return ret;
+  }
+
+  //return the books having all the keys in the order of ISBN. the posting lists in map are read in turns until the rarest
+  //one ends, then the candidates are intersected by heap position with each other list read in full, or probed if much longer
+  template<typename T, class KEYS>
+  std::vector<BookRef> match(BookMap<T> &map, const KEYS &keys) { //keys are distinct and convertible to T
+    if (keys.begin() == keys.end()) { //no list to end the loop below
+      return {};
+    }
+    static constexpr int CHUNK = 64; //elements read from a list in each turn
+    static constexpr int PROBE_RATE = 64; //probe a list if it has more elements than PROBE_RATE times the candidates
+    struct Posting {
+      T key;
+      typename BookMap<T>::Iterator it;
+      std::vector<BookRef> refs;
+
+      [[nodiscard]] bool done() const {
+        return it == std::default_sentinel;
+      }
+
+      void read() {
+        refs.push_back((*it).second);
+        ++it;
+      }
+    };
+    std::vector<Posting> lists;
+    for (const auto &k: keys) {
+      T key(k);
+      lists.push_back({key, map.range({key, BookRef::min()}, {key, BookRef::max()}).begin(), {}});
+    }
+    auto rarest = lists.end();
+    while (rarest == lists.end()) {
+      for (auto list = lists.begin(); list != lists.end() && rarest == lists.end(); ++list) {
+        for (int i = 0; i < CHUNK && !list->done(); i++) {
+          list->read();
+        }
+        if (list->done()) {
+          rarest = list;
+        }
+      }
+    }
+    auto byPos = [](const BookRef &a, const BookRef &b) {
+      return a.pos < b.pos;
+    };
+    std::vector<BookRef> candidates = std::move(rarest->refs);
+    std::sort(candidates.begin(), candidates.end(), byPos);
+    lists.erase(rarest);
+    std::sort(lists.begin(), lists.end(), [](const Posting &a, const Posting &b) {
+      return a.refs.size() < b.refs.size();
+    });
+    for (Posting &list: lists) {
+      if (candidates.empty()) {
+        break;
+      }
+      while (!list.done() && list.refs.size() <= PROBE_RATE * candidates.size()) {
+        list.read();
+      }
+      if (!list.done()) {
+        std::erase_if(candidates, [&map, &list](const BookRef &ref) {
+          return !map.contains({list.key, ref});
+        });
+        continue;
+      }
+      std::vector<int> a(candidates.size()), b(list.refs.size()), ids(candidates.size());
+      std::transform(candidates.begin(), candidates.end(), a.begin(), [](const BookRef &ref) {
+        return ref.pos;
+      });
+      std::transform(list.refs.begin(), list.refs.end(), b.begin(), [](const BookRef &ref) {
+        return ref.pos;
+      });
+      std::sort(b.begin(), b.end());
+      ids.resize(intersect(a.data(), static_cast<int>(a.size()), b.data(), static_cast<int>(b.size()), ids.data()));
+      std::erase_if(candidates, [&ids](const BookRef &ref) {
+        return !std::binary_search(ids.begin(), ids.end(), ref.pos);
+      });
+    }
+    std::sort(candidates.begin(), candidates.end());
+    return candidates;
+  }
+
+  void print(const Keywords<60> &keywords) { //print books with all the keywords
+    if (keywords.size() == 1) {
+      print(keywordMap, String60(keywords[0]), String60(keywords[0]));
+      return;
+    }
+    std::vector<BookRef> refs = match(keywordMap, keywords);
+    for (const BookRef &ref: refs) {
+      std::cout << bookHeap.get(ref.pos) << '\n';
+    }
+    if (refs.empty()) {
+      std::cout << '\n';
+    }
+  }
+
+  //print at most SEARCH_LIMIT books whose name or author contains text in the order of ISBN
+  //candidates having all the trigrams of text are checked against the book. text shorter than 3 characters has no trigram,
+  //so books are scanned in the order of ISBN until SEARCH_LIMIT of them match
+  void search(char field, const String60 &text) {
+    std::string_view pattern(text.begin(), text.end());
+    int cnt = 0;
+    auto check = [field, pattern, &cnt](const BookRef &ref) { //print the book if matched. return whether to go on
+      Book book = bookHeap.get(ref.pos);
+      const String60 &s = field == NAME_FIELD ? book.name : book.author;
+      if (std::string_view(s.begin(), s.end()).find(pattern) != std::string_view::npos) {
+        std::cout << book << '\n';
+        cnt++;
+      }
+      return cnt < SEARCH_LIMIT;
+    };
+    Grams keys = grams(field, text);
+    if (keys.empty()) {
+      for (const std::pair<String20, BookRef> &p: isbnMap.range({String20::min(), BookRef::min()},
+                                                                {String20::max(), BookRef::max()})) {
+        if (!check(p.second)) {
+          break;
+        }
+      }
+    } else {
+      for (const BookRef &ref: match(gramMap, keys)) {
+        if (!check(ref)) {
+          break;
+        }
+      }
+    }
+    if (cnt == 0) {
+      std::cout << '\n';
+    }
+  }
+
+  void compact() { //compact all maps and print the bytes reclaimed
+    std::cout << "isbn\t" << isbnMap.compact() + isbnHash.compact() << '\n';
+    std::cout << "name\t" << nameMap.compact() << '\n';
+    std::cout << "author\t" << authorMap.compact() << '\n';
+    std::cout << "keyword\t" << keywordMap.compact() << '\n';
+    std::cout << "gram\t" << gramMap.compact() << '\n';
+    std::cout << "price\t" << priceMap.compact() << '\n';
+  }
+
+  void stats() { //print the depth and the number of buckets of the hash index and the statistics of its bloom filters
+    std::cout << "isbn\t" << isbnHash.depth() << '\t' << isbnHash.buckets() << '\t' << isbnHash.stats() << '\n';
+  }
+
+  void init() {
+    if (hashing || indexing || pricing) {
+      for (const std::pair<String20, BookRef> &p: isbnMap.range({String20::min(), BookRef::min()},
+                                                                {String20::max(), BookRef::max()})) {
+        if (hashing) {
+          isbnHash.put(p.first, p.second);
+        }
+        if (!indexing && !pricing) {
+          continue;
+        }
+        Book book = bookHeap.get(p.second.pos);
+        if (indexing) {
+          updateGrams(NAME_FIELD, String60{}, book.name, p.second, p.second);
+          updateGrams(AUTHOR_FIELD, String60{}, book.author, p.second, p.second);
+        }
+        if (pricing) {
+          priceMap.put(book.price, p.second);
+        }
+      }
+    }
+    if (!upgrading) {
+      return;
+    }
+    {
+      PersistentMap<String20, LegacyBook, 450> old(false, "isbn.old");
+      for (const std::pair<String20, LegacyBook> &p: old.range({String20::min(), LegacyBook::min()},
+                                                               {String20::max(), LegacyBook::max()})) {
+        store(p.second.get());
+      }
+    }
+    for (const char *name: {"isbn", "name", "author", "keyword"}) {
+      std::filesystem::remove(string("storage/") + name + ".old.dat");
+    }
+  }
+
+  void update(const Book &old, const Book &book, int pos) { //save the book at pos. only indexes whose key changed are touched
+    BookRef oldRef{old.isbn, pos}, ref{book.isbn, pos};
+    bool moved = old.isbn != book.isbn; //all refs change with ISBN
+    if (moved) {
+      isbnHash.remove(old.isbn);
+      isbnHash.put(book.isbn, ref);
+      isbnMap.remove(old.isbn, oldRef);
+      isbnMap.put(book.isbn, ref);
+    }
+    if (moved || old.name != book.name) {
+      nameMap.remove(old.name, oldRef);
+      nameMap.put(book.name, ref);
+      updateGrams(NAME_FIELD, old.name, book.name, oldRef, ref);
+    }
+    if (moved || old.author != book.author) {
+      authorMap.remove(old.author, oldRef);
+      authorMap.put(book.author, ref);
+      updateGrams(AUTHOR_FIELD, old.author, book.author, oldRef, ref);
+    }
+    if (moved || old.price != book.price) {
+      priceMap.remove(old.price, oldRef);
+      priceMap.put(book.price, ref);
+    }
+    if (moved || old.keyword != book.keyword) {
+      auto oldKeywords = old.keyword.split(), keywords = book.keyword.split();
+      for (std::string_view kw: oldKeywords) {
+        if (moved || !keywords.contains(kw)) {
+          keywordMap.remove(String60(kw), oldRef);
+        }
+      }
+      for (std::string_view kw: keywords) {
+        if (moved || !oldKeywords.contains(kw)) {
+          keywordMap.put(String60(kw), ref);
+        }
+      }
+    }
+    if (moved || old.name != book.name || old.author != book.author || old.keyword != book.keyword ||
+        old.price != book.price || old.stock != book.stock) {
+      bookHeap.set(book, pos);
     }
   }
 
-  struct PersistentBook: public Book {
+  struct PersistentBook : public Book { //changes are saved when destructed if save is set
     bool save = false;
+    Book origin;
+    int pos;
 
-    explicit PersistentBook(const Book &book): Book(book) {}
+    PersistentBook(const Book &book, int pos) : Book(book), origin(book), pos(pos) {}
 
     ~PersistentBook() {
-      if (!this->empty() && save) {
-        store(*this);
+      if (save) {
+        update(origin, *this, pos);
       }
     }
   };
 
-  PersistentBook extract(const String20 &isbn) { //extract the book with the given ISBN_TYPE and remove it. set the save flag to save it
-    PersistentBook ret(isbnMap.get(isbn));
-    if (ret.empty()) {
+  PersistentBook edit(const String20 &isbn) { //get the book with the given ISBN_TYPE to modify. set the save flag to save it
+    BookRef ref = isbnHash.get(isbn);
+    if (ref.empty()) {
       throw Error("ISBN empty when extracting");
     }
-    isbnMap.remove(ret.isbn, ret);
-    nameMap.remove(ret.name, ret);
-    authorMap.remove(ret.author, ret);
-    for (const String60 &kw: ret.keyword.split()) {
-      keywordMap.remove(kw, ret);
-    }
-    return ret;
+    return {bookHeap.get(ref.pos), ref.pos};
   }
 }
 #endif //BOOKSTORE_BOOK_HPP
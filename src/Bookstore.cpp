@@ -4,6 +4,8 @@
 
 int main() {
   Accounts::init();
+  Books::init();
+  Logs::init();
   Commands::init();
   std::string input;
   std::string label;
@@ -13,7 +15,7 @@ int main() {
     std::cout << label << '\n';
     try {
       Commands::run(input);
-      Logs::addLog(current, input);
+      Commands::log(current);
       std::cout << "SUCCESS" << '\n';
     } catch (Error &ex) {
       std::cerr << ex.getMessage() << '\n';
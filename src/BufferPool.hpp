@@ -0,0 +1,168 @@
+//
+// Created by zjx on 2024/1/8.
+//
+
+#ifndef BOOKSTORE_BUFFER_POOL_HPP
+#define BOOKSTORE_BUFFER_POOL_HPP
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <functional>
+
+#ifndef BUFFER_POOL_SIZE
+#define BUFFER_POOL_SIZE (16 << 20) //default memory budget in bytes shared by all files
+#endif
+
+class PageOwner { //a file whose pages can be cached in the buffer pool
+public:
+  virtual void writePage(int index, const char *data) = 0; //write a dirty page back
+
+  virtual ~PageOwner() = default;
+};
+
+//a buffer pool shared by all FileStorage with LRU eviction and dirty write-back
+//pages are identified by (owner, index). pinned pages are never evicted
+class BufferPool {
+private:
+  struct Frame {
+    PageOwner *owner;
+    int index;
+    int size;
+    int pinCount;
+    bool dirty;
+    std::unique_ptr<char[]> data;
+  };
+
+  struct Key {
+    PageOwner *owner;
+    int index;
+
+    bool operator==(const Key &other) const = default;
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key &key) const {
+      return std::hash<PageOwner *>()(key.owner) ^ (std::hash<int>()(key.index) * 0x9E3779B97F4A7C15ull);
+    }
+  };
+
+  std::list<Frame> frames; //front is the most recently used
+  std::unordered_map<Key, std::list<Frame>::iterator, KeyHash> table;
+  size_t capacity;
+  size_t used = 0;
+  long long hitCount = 0;
+  long long missCount = 0;
+
+  void writeBack(Frame &frame) {
+    if (frame.dirty) {
+      frame.owner->writePage(frame.index, frame.data.get());
+      frame.dirty = false;
+    }
+  }
+
+  void evict(std::list<Frame>::iterator it) {
+    writeBack(*it);
+    used -= it->size;
+    table.erase({it->owner, it->index});
+    frames.erase(it);
+  }
+
+  void shrink(size_t need) { //evict unpinned pages from the least recently used until need bytes fit
+    auto it = frames.end();
+    while (used + need > capacity && it != frames.begin()) {
+      --it;
+      if (it->pinCount == 0) {
+        evict(it++);
+      }
+    }
+  }
+
+public:
+  explicit BufferPool(size_t capacity) : capacity(capacity) {}
+
+  //return the cached page and mark it as most recently used. nullptr if not cached
+  char *find(PageOwner *owner, int index) {
+    auto it = table.find({owner, index});
+    if (it == table.end()) {
+      missCount++;
+      return nullptr;
+    }
+    hitCount++;
+    frames.splice(frames.begin(), frames, it->second);
+    return it->second->data.get();
+  }
+
+  //make room for a new page and return its buffer. the caller should fill it
+  char *insert(PageOwner *owner, int index, int size) {
+    shrink(size);
+    frames.push_front({owner, index, size, 0, false, std::make_unique<char[]>(size)});
+    table[{owner, index}] = frames.begin();
+    used += size;
+    return frames.front().data.get();
+  }
+
+  //keep a cached page from being evicted until it is unpinned as many times. the page must be cached
+  void pin(PageOwner *owner, int index) {
+    table.at({owner, index})->pinCount++;
+  }
+
+  //undo one pin, marking the page dirty if the caller changed it
+  void unpin(PageOwner *owner, int index, bool dirty) {
+    Frame &frame = *table.at({owner, index});
+    frame.pinCount--;
+    frame.dirty |= dirty;
+  }
+
+  //mark a cached page as changed, so that it is written back when evicted or flushed
+  void markDirty(PageOwner *owner, int index) {
+    table.at({owner, index})->dirty = true;
+  }
+
+  //drop a page without writing it back, used when the page is removed from the file
+  void discard(PageOwner *owner, int index) {
+    auto it = table.find({owner, index});
+    if (it != table.end()) {
+      used -= it->second->size;
+      frames.erase(it->second);
+      table.erase(it);
+    }
+  }
+
+  void flush(PageOwner *owner) { //write back all dirty pages of the owner
+    for (Frame &frame: frames) {
+      if (frame.owner == owner) {
+        writeBack(frame);
+      }
+    }
+  }
+
+  void release(PageOwner *owner, bool writeBack = true) { //drop all pages of the owner, writing back dirty ones if needed
+    for (auto it = frames.begin(); it != frames.end();) {
+      if (it->owner == owner) {
+        if (!writeBack) {
+          it->dirty = false;
+        }
+        evict(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  [[nodiscard]] size_t size() const {
+    return used;
+  }
+
+  [[nodiscard]] long long hits() const {
+    return hitCount;
+  }
+
+  [[nodiscard]] long long misses() const {
+    return missCount;
+  }
+};
+
+BufferPool bufferPool(BUFFER_POOL_SIZE);
+
+#endif //BOOKSTORE_BUFFER_POOL_HPP
@@ -7,7 +7,6 @@
 
 #include <string>
 #include <sstream>
-#include <regex>
 #include <functional>
 #include <optional>
 #include <utility>
@@ -16,42 +15,101 @@
 #include "Account.hpp"
 #include "Status.hpp"
 #include "Log.hpp"
+#include "Sales.hpp"
 #include "StringReader.hpp"
 
 namespace {
-  typedef std::function<void()> Runnable;
+  typedef void (*Runnable)();
   StringReader currentCommand;
   struct Command {
-    std::string name;
+    std::string_view name; //empty if the slot is unused
     Privilege minPrivilege = GUEST;
-    Runnable getArgs;
-    Runnable execute;
+    Runnable getArgs = nullptr;
+    Runnable execute = nullptr;
+
+    [[nodiscard]] bool is(std::string_view first, std::string_view second) const { //whether named "first second"
+      if (second.empty()) {
+        return name == first;
+      }
+      return name.size() == first.size() + 1 + second.size() && name.starts_with(first) &&
+             name[first.size()] == ' ' && name.ends_with(second);
+    }
   }; //always check before execute
 
-  std::map<std::string, Command> commands;
+  constexpr std::string_view COMMAND_NAMES[] = {
+    "exit", "quit", "su", "logout", "register", "passwd", "useradd", "delete", "show", "show count", "buy", "select",
+    "modify", "import", "show finance", "report finance", "report employee", "report bestsellers", "log", "addBook",
+    "compact", "show stats", "showUser"
+  };
+  constexpr int COMMAND_SLOTS = 64;
+
+  constexpr int commandSlot(std::string_view first, std::string_view second, uint32_t seed) {
+    //slot of "first second", or of first if second is empty. hashed in parts so no string is built
+    uint32_t h = 2166136261u ^ seed * 0x9E3779B9u; //FNV-1a from a seeded basis
+    for (char c: first) {
+      h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    if (!second.empty()) {
+      h = (h ^ static_cast<unsigned char>(' ')) * 16777619u;
+      for (char c: second) {
+        h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+      }
+    }
+    h ^= h >> 16;
+    return static_cast<int>(h % COMMAND_SLOTS);
+  }
+
+  constexpr int commandSlot(std::string_view name, uint32_t seed) {
+    size_t space = name.find(' ');
+    return space == std::string_view::npos ? commandSlot(name, {}, seed) :
+           commandSlot(name.substr(0, space), name.substr(space + 1), seed);
+  }
+
+  constexpr uint32_t findCommandSeed() { //the first seed giving every command its own slot, i.e. a perfect hash
+    for (uint32_t seed = 0;; seed++) {
+      bool used[COMMAND_SLOTS]{};
+      bool perfect = true;
+      for (std::string_view name: COMMAND_NAMES) {
+        int slot = commandSlot(name, seed);
+        perfect &= !used[slot];
+        used[slot] = true;
+      }
+      if (perfect) {
+        return seed;
+      }
+    }
+  }
+
+  constexpr uint32_t COMMAND_SEED = findCommandSeed();
+  Command commands[COMMAND_SLOTS];
+  const Command *lastCommand = nullptr; //the command run last, nullptr for an empty line
+  std::string_view lastArgs; //the text after its name, a view into the line
 
-  void addCommand(const std::string &name, Privilege minPrivilege, const Runnable &getArgs, const Runnable &execute) {
-    commands[name] = {name, minPrivilege, getArgs, execute};
+  void addCommand(std::string_view name, Privilege minPrivilege, Runnable getArgs, Runnable execute) {
+    if (std::find(std::begin(COMMAND_NAMES), std::end(COMMAND_NAMES), name) == std::end(COMMAND_NAMES)) {
+      throw Error("Command not in COMMAND_NAMES"); //so the hash might not be perfect for it
+    }
+    commands[commandSlot(name, COMMAND_SEED)] = {name, minPrivilege, getArgs, execute};
   }
 
   template<typename T>
   class Scanner { //needn't reset if you just visit those evaluated
-    std::regex reg;
+    const Pattern &pattern;
   public:
     std::optional<T> value; //init with empty
 
-    explicit Scanner(std::regex pattern) : reg(std::move(pattern)) {}
+    explicit Scanner(const Pattern &pattern) : pattern(pattern) {}
 
-    T toT(const std::string &s) {
-      std::smatch match;
-      if (!std::regex_match(s, match, reg)) {
+    T toT(std::string_view s) {
+      std::optional<std::string_view> match = pattern.match(s);
+      if (!match) {
         throw SyntaxError();
       }
-      return fromString<T>(match[1]);
+      return fromString<T>(*match);
     }
 
     void require() {
-      std::string s = currentCommand.get();
+      std::string_view s = currentCommand.get();
       if (s.empty()) {
         throw SyntaxError();
       }
@@ -59,7 +117,7 @@ namespace {
     }
 
     void optional() {
-      std::string s = currentCommand.get();
+      std::string_view s = currentCommand.get();
       if (!s.empty()) {
         value.emplace(toT(s));
       } else {
@@ -89,28 +147,40 @@ namespace {
   Scanner AUTHOR = Scanner<String60>(AUTHOR_PATTERN);
   Scanner KEYWORD = Scanner<String60>(KEYWORD_PATTERN);
   Scanner COUNT = Scanner<int>(COUNT_PATTERN);
-  Scanner PRICE = Scanner<Double>(PRICE_PATTERN);
+  Scanner PRICE = Scanner<Money>(PRICE_PATTERN);
+  Scanner PRICE2 = Scanner<Money>(PRICE_PATTERN); //upper bound of a price range in search
+  Scanner SINCE = Scanner<Time>(TIME_PATTERN);
+  Scanner UNTIL = Scanner<Time>(TIME_PATTERN);
   std::set<BookDataID> BOOK_DATA_IDS; //similar to Scanner, call scanArgs() to assign value
+  bool SUBSTRING; //whether the name or author is searched by substring, i.e. -name~="..."
 
   void scanBookArgs(bool search) { //search is used to check
     BOOK_DATA_IDS.clear();
-    std::string s;
+    SUBSTRING = false;
+    std::string_view s;
     BookDataID type;
     while (!currentCommand.empty()) {
       s = currentCommand.get();
-      std::smatch result;
-      if(!std::regex_match(s, result, ARGS_PATTERN)) {
+      std::string_view key, value;
+      if (!splitArg(s, key, value)) {
         throw SyntaxError();
       }
-      type = fromString<BookDataID>(result[1]);
+      if (search && key.ends_with('~')) {
+        key.remove_suffix(1);
+        SUBSTRING = true;
+      }
+      type = fromString<BookDataID>(key);
+      if (SUBSTRING && type != NAME_TYPE && type != AUTHOR_TYPE) {
+        throw Error("Cannot search by substring");
+      }
       if (!BOOK_DATA_IDS.insert(type).second) {
         throw Error("Duplicate argument");
       }
-      currentCommand.store(result[2]);
+      currentCommand.store(value);
       switch (type) {
         case ISBN_TYPE:
           ISBN.require();
-          if (!search && !Books::isbnMap.get(ISBN.get()).empty()) {
+          if (!search && Books::exists(ISBN.get())) {
             throw Error("ISBN already exists");
           }
           break;
@@ -120,18 +190,29 @@ namespace {
         case AUTHOR_TYPE:
           AUTHOR.require();
           break;
-        case PRICE_TYPE:
-          if (search) {
-            throw Error("Cannot search by price");
+        case PRICE_TYPE: {
+          if (!search) {
+            PRICE.require();
+            break;
           }
-          PRICE.require();
+          s = currentCommand.get(); //LOW..HIGH where either end may be omitted, or a single price
+          size_t dots = s.find("..");
+          if (dots == std::string_view::npos) {
+            PRICE.value.emplace(PRICE.toT(s));
+            PRICE2.value = PRICE.value;
+            break;
+          }
+          std::string_view low = s.substr(0, dots), high = s.substr(dots + 2);
+          if (low.empty() && high.empty()) {
+            throw SyntaxError();
+          }
+          PRICE.value.emplace(low.empty() ? Money::min() : PRICE.toT(low));
+          PRICE2.value.emplace(high.empty() ? Money::max() : PRICE2.toT(high));
           break;
+        }
         case KEYWORD_TYPE:
           KEYWORD.require();
-          auto v = KEYWORD.get().split(); //check valid
-          if (search && v.size() > 1) {
-            throw Error("Too many keywords for search");
-          }
+          (void) KEYWORD.get().split(); //check valid
           break;
       }
     }
@@ -142,6 +223,31 @@ namespace {
       throw Error("No argument for modify");
     }
   }
+
+  void scanTimeArgs(bool count) { //-since=[Time] and -until=[Time] in any order, or a single count if allowed
+    SINCE.value = UNTIL.value = std::nullopt;
+    COUNT.value = std::nullopt;
+    while (!currentCommand.empty()) {
+      std::string_view s = currentCommand.get();
+      std::string_view key, value;
+      if (!splitArg(s, key, value)) {
+        if (!count || !currentCommand.empty() || SINCE.present() || UNTIL.present()) {
+          throw SyntaxError();
+        }
+        currentCommand.store(s);
+        COUNT.require();
+        return;
+      }
+      currentCommand.store(value);
+      if (key == "since" && !SINCE.present()) {
+        SINCE.require();
+      } else if (key == "until" && !UNTIL.present()) {
+        UNTIL.require();
+      } else {
+        throw SyntaxError();
+      }
+    }
+  }
 }
 
 namespace Commands {
@@ -230,32 +336,49 @@ namespace Commands {
       scanBookArgs(true);
     }, []() {
       if (BOOK_DATA_IDS.empty()) {
-        Books::isbnMap.printAll(String20::min(), String20::max());
+        Books::print(Books::isbnMap, String20::min(), String20::max());
         return;
       }
       BookDataID id = *BOOK_DATA_IDS.begin(); //the only one
       switch (id) {
         case ISBN_TYPE:
-          Books::isbnMap.print(ISBN.get());
+          Books::print(ISBN.get());
           break;
         case NAME_TYPE:
-          Books::nameMap.print(NAME.get());
+          if (SUBSTRING) {
+            Books::search(Books::NAME_FIELD, NAME.get());
+          } else {
+            Books::print(Books::nameMap, NAME.get(), NAME.get());
+          }
           break;
         case AUTHOR_TYPE:
-          Books::authorMap.print(AUTHOR.get());
+          if (SUBSTRING) {
+            Books::search(Books::AUTHOR_FIELD, AUTHOR.get());
+          } else {
+            Books::print(Books::authorMap, AUTHOR.get(), AUTHOR.get());
+          }
           break;
         case KEYWORD_TYPE:
-          Books::keywordMap.print(KEYWORD.get());
+          Books::print(KEYWORD.get().split()); //books with all the keywords
           break;
         case PRICE_TYPE:
-          throw Error("Cannot search by price, this should not happen!");
+          Books::print(Books::priceMap, PRICE.get(), PRICE2.get()); //in the order of price
+          break;
       }
     });
+    addCommand("show count", CUSTOMER, []() {
+      scanBookArgs(true);
+      if (!BOOK_DATA_IDS.contains(PRICE_TYPE)) {
+        throw Error("Can only count by price");
+      }
+    }, []() {
+      std::cout << Books::count(Books::priceMap, PRICE.get(), PRICE2.get()) << '\n';
+    });
     addCommand("buy", CUSTOMER, []() {
       ISBN.require();
       COUNT.require();
     }, []() {
-      auto book = Books::extract(ISBN.get());
+      auto book = Books::edit(ISBN.get());
       book.save = true;
       if (book.stock < COUNT.get()) {
         throw Error("Not enough stock");
@@ -263,26 +386,22 @@ namespace Commands {
       if(COUNT.get() <= 0) {
         throw Error("Invalid count");
       }
-      Double cost = book.price * COUNT.get();
+      Money cost = book.price * COUNT.get();
       book.stock -= COUNT.get();
       std::cout << cost << '\n';
-      Logs::addFinanceLog(cost, Double::min());
+      Sales::add(book.pos, COUNT.get(), cost, Logs::addFinanceLog(cost, Money::min()));
     });
     addCommand("select", CLERK, []() {
       ISBN.require();
     }, []() {
       String20 isbn = ISBN.get();
-      Book tmp = Books::isbnMap.get(isbn);
-      if (tmp.empty()) {
-        tmp.isbn = isbn; //may be empty, create a new one and store it
-        Books::store(tmp);
-      }
+      Books::store(Book{isbn}); //create a new one if not exists
       Statuses::select(isbn);
     });
     addCommand("modify", CLERK, []() {
       scanBookArgs(false);
     }, []() {
-      auto book = Books::extract(Statuses::currentISBN());
+      auto book = Books::edit(Statuses::currentISBN());
       book.save = true;
       for (BookDataID id: BOOK_DATA_IDS) {
         switch (id) {
@@ -312,17 +431,21 @@ namespace Commands {
       if(COUNT.get() <= 0) {
         throw Error("Count must be positive");
       }
-      if(PRICE.get() <= Double::min()) {
+      if(PRICE.get() <= Money::min()) {
         throw Error("Price must be positive");
       }
-      auto book = Books::extract(Statuses::currentISBN());
+      auto book = Books::edit(Statuses::currentISBN());
       book.save = true;
       book.stock += COUNT.get();
-      Logs::addFinanceLog(Double::min(), PRICE.get());
+      Logs::addFinanceLog(Money::min(), PRICE.get());
     });
     addCommand("show finance", ADMIN, []() {
-      COUNT.optional();
+      scanTimeArgs(true);
     }, []() {
+      if (SINCE.present() || UNTIL.present()) {
+        Logs::printFinanceLog(SINCE.present() ? SINCE.get() : Time::min(), UNTIL.present() ? UNTIL.get() : Time::max());
+        return;
+      }
       Logs::printFinanceLog(COUNT.present() ? COUNT.get() : -1);
     });
     addCommand("report finance", ADMIN, []() {}, []() {
@@ -331,21 +454,33 @@ namespace Commands {
     addCommand("report employee", ADMIN, []() {}, []() {
       Logs::reportEmployee();
     });
-    addCommand("log", ADMIN, []() {}, []() {
-      Logs::reportFull();
+    addCommand("report bestsellers", ADMIN, []() {
+      COUNT.require();
+    }, []() {
+      Sales::reportBestsellers(COUNT.get());
+    });
+    addCommand("log", ADMIN, []() {
+      scanTimeArgs(false);
+    }, []() {
+      Logs::reportFull(SINCE.present() ? SINCE.get() : Time::min(), UNTIL.present() ? UNTIL.get() : Time::max());
     });
     addCommand("addBook", CLERK, []() {
       ISBN.require();
     }, []() {
-      String20 isbn = ISBN.get();
-      Book tmp = Books::isbnMap.get(isbn);
-      if (tmp.empty()) {
-        tmp.isbn = isbn; //create a new one and store it
-        Books::store(tmp);
-      } else {
+      if (!Books::store(Book{ISBN.get()})) { //create a new one if not exists
         throw Error("ISBN already exists");
       }
     });
+    addCommand("compact", ADMIN, []() {}, []() {
+      Books::compact();
+      Accounts::compact();
+      Sales::compact();
+    });
+    addCommand("show stats", ADMIN, []() {}, []() {
+      std::cout << "pool\t" << bufferPool.hits() << '\t' << bufferPool.misses() << '\n';
+      Books::stats();
+      Accounts::stats();
+    });
     addCommand("showUser", GUEST, []() {}, []() {
       Statuses::printAccounts();
     });
@@ -353,28 +488,36 @@ namespace Commands {
 
   void run(const std::string &command) {
     currentCommand = StringReader(command); //set the currentCommand every time
+    lastCommand = nullptr;
+    lastArgs = {};
     if(currentCommand.empty()){
       return; //skip empty line
     }
-    std::string name = currentCommand.get();
-    std::string name2 = currentCommand.touch();
-    std::string newName = name + " " + name2;
-    if(commands.find(newName) != commands.end()) { //first try to find the command with two words
+    std::string_view name = currentCommand.get();
+    std::string_view name2 = currentCommand.touch();
+    const Command *cmd = &commands[commandSlot(name, name2, COMMAND_SEED)];
+    if (!name2.empty() && cmd->is(name, name2)) { //first try to find the command with two words
       currentCommand.get(); //skip the second word
-      name = newName; //set the name
-    }
-    if(commands.find(name) == commands.end()) {
-      throw Error("Invalid command");
+    } else {
+      cmd = &commands[commandSlot(name, {}, COMMAND_SEED)];
+      if (!cmd->is(name, {})) {
+        throw Error("Invalid command");
+      }
     }
-    const Command &cmd = commands[name];
-    if (Statuses::currentPrivilege() < cmd.minPrivilege) {
+    lastCommand = cmd;
+    lastArgs = currentCommand.rest();
+    if (Statuses::currentPrivilege() < cmd->minPrivilege) {
       throw PermissionDenied();
     }
-    cmd.getArgs();
+    cmd->getArgs();
     if (!currentCommand.empty()) {
       throw SyntaxError(); //check whether there are redundant arguments
     }
-    cmd.execute();
+    cmd->execute();
+  }
+
+  void log(const Account &account) { //log the command run last by account, which must have succeeded
+    Logs::addLog(account, lastCommand ? lastCommand->name : std::string_view(), lastArgs);
   }
 }
 #endif //BOOKSTORE_COMMAND_HPP
\ No newline at end of file
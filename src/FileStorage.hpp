@@ -4,6 +4,8 @@
 #include <fstream>
 #include <iostream>
 #include <filesystem>
+#include <cstring>
+#include "BufferPool.hpp"
 
 using std::string;
 using std::fstream;
@@ -11,14 +13,19 @@ using std::ifstream;
 using std::ofstream;
 
 template<class T, class INFO>
-//a simple file storage class without cache
-class FileStorage {
+//a simple file storage class. objects are cached in the shared buffer pool and written back when evicted
+class FileStorage : public PageOwner {
 private:
   fstream file;
   string fileName;
+  BufferPool &pool; //the pool caching objects of this file
+  int empty; //cached pointer to first empty, written back in flush
+  INFO info; //cached info, written back in flush
+  int end; //logical end of file. dirty objects may not be written yet
   static constexpr int T_SIZE = sizeof(T);
   static constexpr int INFO_LEN = sizeof(INFO);
   static constexpr int INT_SIZE = sizeof(int);
+  static constexpr int START = (INFO_LEN + INT_SIZE + alignof(T) - 1) / alignof(T) * alignof(T); //so that T can be used in place
 
   int getEmpty() {
     file.seekg(INFO_LEN);
@@ -32,85 +39,161 @@ private:
     file.write(reinterpret_cast<const char *>(&x), INT_SIZE);
   }
   //store pointer to first empty just after info len.
-  //empty except end has pointer to next empty; check EOF to determine whether at end. (so don't store anything after this)
+  //empty except end has pointer to next empty; check end to determine whether at end. (so don't store anything after this)
+
+  char *load(int index) { //return the cached page, read it from file if necessary
+    char *page = pool.find(this, index);
+    if (page == nullptr) {
+      page = pool.insert(this, index, T_SIZE);
+      file.seekg(index);
+      file.read(page, T_SIZE);
+    }
+    return page;
+  }
+
+  char *allocate(int index) { //return the cached page without reading as it will be overwritten
+    char *page = pool.find(this, index);
+    return page == nullptr ? pool.insert(this, index, T_SIZE) : page;
+  }
+
 public:
-  explicit FileStorage(const string &file_name) : fileName("storage/"+file_name+".dat") {
-    init();
+  explicit FileStorage(const string &file_name, BufferPool &pool = bufferPool) : fileName("storage/"+file_name+".dat"), pool(pool) {
+    create(fileName);
     file.open(fileName, std::ios::in | std::ios::out | std::ios::binary);
+    empty = getEmpty();
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(&info), INFO_LEN);
+    end = static_cast<int>(std::filesystem::file_size(fileName));
   }
 
-  ~FileStorage() {
+  ~FileStorage() override {
+    flush();
+    pool.release(this);
     file.close();
   }
 
-  void init() {
+  static void create(const string &fileName) { //create the file with empty info if not exists
     if (std::filesystem::exists(fileName)) {
       return;
     }
     std::filesystem::create_directory("storage");
-    file.open(fileName, std::ios::out | std::ios::binary);
+    ofstream file(fileName, std::ios::out | std::ios::binary);
     INFO tmp{};
     file.write(reinterpret_cast<const char *>(&tmp), INFO_LEN);
-    int empty = INFO_LEN + INT_SIZE;
+    int empty = START;
     file.write(reinterpret_cast<const char *>(&empty), INT_SIZE);
-    file.close();
+    char padding[START - INFO_LEN - INT_SIZE + 1]{};
+    file.write(padding, START - INFO_LEN - INT_SIZE);
   }
 
-  INFO getInfo() {
-    file.seekg(0);
-    INFO ret;
-    file.read(reinterpret_cast<char *>(&ret), INFO_LEN);
-    return ret;
+  void writePage(int index, const char *data) override {
+    file.seekp(index);
+    file.write(data, T_SIZE);
   }
 
-  void setInfo(const INFO &info) {
+  void flush() { //write back all dirty objects, the empty pointer and info
+    pool.flush(this);
+    setEmpty(empty);
     file.seekp(0);
     file.write(reinterpret_cast<const char *>(&info), INFO_LEN);
+    file.flush();
   }
 
-  //find an empty place to add T and return the index of the object
-  int add(const T &t) {
-    int index = getEmpty();
-    file.seekg(index);
+  void clear() { //remove all objects and truncate the file. info is kept
+    pool.release(this, false);
+    file.close();
+    std::filesystem::resize_file(fileName, START);
+    file.open(fileName, std::ios::in | std::ios::out | std::ios::binary);
+    empty = end = START;
+  }
+
+  static constexpr int start() { //index of the first object
+    return START;
+  }
+
+  [[nodiscard]] int size() const { //logical size of the file in bytes
+    return end;
+  }
+
+  INFO getInfo() {
+    return info;
+  }
+
+  void setInfo(const INFO &newInfo) { //cheap, so containers may call it whenever their info changes
+    info = newInfo;
+  }
+
+  //find an empty place for a new object and return its index. the object should be filled by set or pin
+  int add() {
+    int index = empty;
     int nxt;
-    if (file.peek() == EOF) {
+    if (index >= end) {
       nxt = index + T_SIZE;
-      file.clear();
+      end = nxt;
     } else {
+      file.seekg(index);
       file.read(reinterpret_cast<char *>(&nxt), INT_SIZE);
     }
-    file.seekp(index);
-    file.write(reinterpret_cast<const char *>(&t), T_SIZE);
-    setEmpty(nxt);
+    allocate(index);
+    pool.markDirty(this, index);
+    empty = nxt;
+    return index;
+  }
+
+  //find an empty place to add T and return the index of the object
+  int add(const T &t) {
+    int index = add();
+    set(t, index);
     return index;
   }
 
   //make sure the index is valid
   //update the object at index
-  void set(T &t, int index) {
-    file.seekp(index);
-    file.write(reinterpret_cast<const char *>(&t), T_SIZE);
+  void set(const T &t, int index) {
+    std::memcpy(allocate(index), &t, T_SIZE);
+    pool.markDirty(this, index);
   }
 
   //make sure the index is valid
   //return the object at index
   T get(int index) {
-    file.seekg(index);
     T ret;
-    file.read(reinterpret_cast<char *>(&ret), T_SIZE);
+    std::memcpy(&ret, load(index), T_SIZE);
     return ret;
   }
 
+  //make sure the cnt objects from index are valid and contiguous
+  //copy them to out with a single read. dirty cached objects are written back first
+  void read(int index, int cnt, T *out) {
+    pool.flush(this);
+    file.seekg(index);
+    file.read(reinterpret_cast<char *>(out), static_cast<std::streamsize>(cnt) * T_SIZE);
+  }
+
+  //make sure the index is valid
+  //return the object at index in the buffer pool, which won't be evicted until unpin is called
+  T &pin(int index) {
+    T *ret = reinterpret_cast<T *>(load(index));
+    pool.pin(this, index);
+    return *ret;
+  }
+
+  //make sure the index is pinned
+  //set dirty if the object has been modified
+  void unpin(int index, bool dirty) {
+    pool.unpin(this, index, dirty);
+  }
+
   //make sure the index is valid
   //delete a currently occupied index
   //you should never remove an empty index!
   void remove(int index) {
-    int nxt = getEmpty();
-    setEmpty(index);
+    pool.discard(this, index);
     file.seekp(index);
-    file.write(reinterpret_cast<const char *>(&nxt), INT_SIZE);
+    file.write(reinterpret_cast<const char *>(&empty), INT_SIZE);
+    empty = index;
   }
 };
 
 
-#endif //BPT_FILE_STORAGE_HPP
\ No newline at end of file
+#endif //BPT_FILE_STORAGE_HPP
@@ -5,44 +5,185 @@
 #ifndef BOOKSTORE_LOG_HPP
 #define BOOKSTORE_LOG_HPP
 
+#include "Book.hpp"
 #include "PersistentVector.hpp"
+#include "PersistentLog.hpp"
+#include "AsyncWriter.hpp"
+#include "StringReader.hpp"
 
 struct FinanceLog {
-  Double income;
-  Double outcome;
+  Money income;
+  Money outcome;
 
   friend std::ostream &operator<<(std::ostream &out, const FinanceLog &log) {
     return out << "+ " << log.income << " - " << log.outcome;
   }
 };
 
-PersistentVector<FinanceLog> financeLog("finance");
-PersistentVector<String300> employeeLog("employee");
-PersistentVector<String300> fullLog("full");
+struct LogEvent { //a line of the operation logs, of fixed size so that posting one allocates nothing. formatted when written
+  static constexpr int ARGS = 320; //the longest valid command, a search by all five fields, has 281 characters
+  bool isFinance;
+  Time time;
+  String30 userID; //empty for a guest
+  String30 userName;
+  Privilege privilege;
+  FinanceLog finance;
+  std::string_view command; //a view into the command table, empty for an empty line
+  int length; //of args
+  char args[ARGS]; //the arguments separated by single spaces
+};
+
+struct LegacyFinanceLog { //a finance record written before amounts were kept in cents
+  LegacyMoney income;
+  LegacyMoney outcome;
+
+  [[nodiscard]] FinanceLog get() const {
+    return FinanceLog{income.get(), outcome.get()};
+  }
+};
+
+struct LedgerEntry : public FinanceLog { //a finance record with the sums of all records up to it
+  FinanceLog total;
+  Time time; //never earlier than that of the previous record
+};
+
+bool upgradeLedger() { //move aside the finance log without sums, which was used before the ledger
+  if (!std::filesystem::exists("storage/finance.dat") || std::filesystem::exists("storage/finance.ledger.dat")) {
+    return false;
+  }
+  std::filesystem::rename("storage/finance.dat", "storage/finance.old.dat");
+  return true;
+}
+
+bool upgradeLog(const string &name) { //move aside a log of String300 records, which was used before the segmented log
+  if (!std::filesystem::exists("storage/" + name + ".dat") || std::filesystem::exists("storage/" + name + ".log.dat")) {
+    return false;
+  }
+  std::filesystem::rename("storage/" + name + ".dat", "storage/" + name + ".old.dat");
+  return true;
+}
+
+bool upgradingLedger = upgradeLedger();
+bool upgradingEmployeeLog = upgradeLog("employee");
+bool upgradingFullLog = upgradeLog("full");
+PersistentVector<LedgerEntry> financeLog("finance.ledger");
+#ifdef BOOKSTORE_ASYNC_LOG
+BufferPool logPool(1 << 20); //only used by the log writer thread, as the shared pool is not thread-safe
+PersistentLog employeeLog("employee.log", logPool);
+PersistentLog fullLog("full.log", logPool);
+#else
+PersistentLog employeeLog("employee.log");
+PersistentLog fullLog("full.log");
+#endif
 
 namespace Logs {
-  String300 convert(const std::string& s) {
-    return String300(s.length()>300 ? s.substr(0, 297) + "..." : s);
+  void write(LogEvent &event) {
+    std::stringstream ss;
+    if (event.isFinance) {
+      ss << event.finance;
+    } else {
+      ss << Account{event.userID, {}, event.userName, event.privilege} << ": " << event.command;
+      if (event.length > 0) {
+        ss << ' ' << std::string_view(event.args, event.length);
+      }
+      if (event.privilege >= CLERK) {
+        employeeLog.push_back(event.time.get(), ss.str());
+      }
+    }
+    fullLog.push_back(event.time.get(), ss.str());
   }
 
-  void addFinanceLog(Double income, Double outcome) {
+#ifdef BOOKSTORE_ASYNC_LOG
+  AsyncWriter<LogEvent, 1024> writer(write); //destroyed before the logs, so all events are written at exit
+#endif
+
+  void post(LogEvent &&event) {
+#ifdef BOOKSTORE_ASYNC_LOG
+    writer.push(std::move(event));
+#else
+    write(event);
+#endif
+  }
+
+  void flush() { //wait until the operation logs are up to date
+#ifdef BOOKSTORE_ASYNC_LOG
+    writer.flush();
+#endif
+  }
+
+  void addLedgerEntry(const FinanceLog &f, Time time) {
+    FinanceLog total{};
+    if (financeLog.size() > 0) {
+      LedgerEntry last = financeLog.back();
+      total = last.total;
+      time = std::max(time, last.time);
+    }
+    total.income += f.income;
+    total.outcome += f.outcome;
+    financeLog.push_back({f, total, time});
+  }
+
+  int addFinanceLog(Money income, Money outcome) { //return the number of the record
     FinanceLog f{income, outcome};
-    financeLog.push_back(f);
-    std::stringstream ss;
-    ss << f;
-    fullLog.push_back(convert(ss.str()));
+    Time now = Time::now();
+    addLedgerEntry(f, now);
+    LogEvent event;
+    event.isFinance = true;
+    event.time = now;
+    event.finance = f;
+    post(std::move(event));
+    return financeLog.size();
   }
 
-  void printFinanceLog(int cnt) {
+  FinanceLog sumOfFirst(int cnt) { //sum of the first cnt records
+    return cnt == 0 ? FinanceLog{} : financeLog.get(cnt - 1).total;
+  }
+
+  int countBefore(Time time) { //number of records earlier than time, by binary search as times never decrease
+    int low = 0, high = financeLog.size();
+    while (low < high) {
+      int mid = (low + high) / 2;
+      if (financeLog.get(mid).time < time) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return low;
+  }
+
+  void printFinanceLog(Time since, Time until) { //sum of the records with time in [since, until)
+    FinanceLog total = sumOfFirst(countBefore(until)), before = sumOfFirst(countBefore(since));
+    if (since < until) {
+      total.income = total.income - before.income;
+      total.outcome = total.outcome - before.outcome;
+    } else {
+      total = FinanceLog{};
+    }
+    std::cout << total << '\n';
+  }
+
+  void printFinanceLog(int cnt) { //sum of the last cnt records, all if cnt is -1. read at most two records
     if (cnt == 0) {
       std::cout << '\n';
       return;
     }
+    int size = financeLog.size();
+    if (cnt > size) {
+      throw Error("cnt > size");
+    }
+    if (cnt == -1) {
+      cnt = size;
+    }
     FinanceLog total{};
-    financeLog.iterate(cnt, [&total](const FinanceLog &log) {
-      total.income += log.income;
-      total.outcome += log.outcome;
-    });
+    if (size > 0) {
+      total = financeLog.back().total;
+    }
+    if (cnt < size) {
+      FinanceLog before = financeLog.get(size - cnt - 1).total;
+      total.income = total.income - before.income;
+      total.outcome = total.outcome - before.outcome;
+    }
     std::cout << total << '\n';
   }
 
@@ -52,25 +193,74 @@ namespace Logs {
     });
   }
 
-  void addLog(const Account &account, const std::string &op) {
-    std::stringstream ss;
-    ss << account << ": " << op;
-    if(account.privilege >= CLERK) {
-      employeeLog.push_back(convert(ss.str()));
+  void addLog(const Account &account, std::string_view command, std::string_view args) {
+    LogEvent event;
+    event.isFinance = false;
+    event.time = Time::now();
+    event.userID = account.userID;
+    event.userName = account.userName;
+    event.privilege = account.privilege;
+    event.command = command;
+    event.length = 0;
+    for (StringReader reader(args); !reader.empty();) {
+      std::string_view word = reader.get();
+      if (event.length + 1 + static_cast<int>(word.size()) > LogEvent::ARGS) {
+        break; //never for a valid command
+      }
+      if (event.length > 0) {
+        event.args[event.length++] = ' ';
+      }
+      std::memcpy(event.args + event.length, word.data(), word.size());
+      event.length += static_cast<int>(word.size());
     }
-    fullLog.push_back(convert(ss.str()));
+    post(std::move(event));
   }
 
   void reportEmployee() {
-    employeeLog.iterateFromBegin([](const String300 &log) {
+    flush();
+    employeeLog.iterateFromBegin([](std::string_view log) {
       std::cout << log << '\n';
     });
   }
 
-  void reportFull() {
-    fullLog.iterateFromBegin([](const String300 &log) {
+  void migrateLog(const string &name, PersistentLog &log) { //copy the old String300 records of name into log
+    {
+      PersistentVector<String300> old(name + ".old");
+      old.iterateFromBegin([&log](const String300 &s) {
+        log.push_back(Time::min().get(), std::string_view(s.begin(), s.end()));
+      });
+    }
+    std::filesystem::remove("storage/" + name + ".old.dat");
+  }
+
+  void init() {
+    if (upgradingEmployeeLog) {
+      migrateLog("employee", employeeLog);
+    }
+    if (upgradingFullLog) {
+      migrateLog("full", fullLog);
+    }
+    if (upgradingLedger) {
+      {
+        PersistentVector<LegacyFinanceLog> old("finance.old");
+        old.iterateFromBegin([](const LegacyFinanceLog &log) {
+          addLedgerEntry(log.get(), Time::min());
+        });
+      }
+      std::filesystem::remove("storage/finance.old.dat");
+    }
+  }
+
+  void reportFull(Time since = Time::min(), Time until = Time::max()) { //records with time in [since, until)
+    flush();
+    auto print = [](std::string_view log) {
       std::cout << log << '\n';
-    });
+    };
+    if (since == Time::min() && until == Time::max()) {
+      fullLog.iterateFromBegin(print);
+    } else {
+      fullLog.iterateBetween(since.get(), until.get(), print);
+    }
   }
 }
 #endif //BOOKSTORE_LOG_HPP
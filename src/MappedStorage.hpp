@@ -0,0 +1,205 @@
+//
+// Created by zjx on 2024/1/9.
+//
+
+#ifndef BOOKSTORE_MAPPED_STORAGE_HPP
+#define BOOKSTORE_MAPPED_STORAGE_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "FileStorage.hpp"
+#include "Error.hpp"
+
+template<class T, class INFO>
+//a file storage backed by mmap with the same layout and interface as FileStorage
+//objects are accessed in place. address space is reserved once so pinned objects stay valid when the file grows
+class MappedStorage : public PageOwner {
+private:
+  int fd;
+  string fileName;
+  BufferPool &pool; //the pool caching objects of this file
+  char *base;
+  int end; //logical end of file. the file is always of this size, so it survives a crash
+  size_t mapped = 0; //bytes of the file currently mapped
+  bool aligned; //files created before the aligned layout are accessed through the buffer pool when pinned
+  static constexpr int T_SIZE = sizeof(T);
+  static constexpr int INFO_LEN = sizeof(INFO);
+  static constexpr int INT_SIZE = sizeof(int);
+  static constexpr int START = (INFO_LEN + INT_SIZE + alignof(T) - 1) / alignof(T) * alignof(T); //same as FileStorage
+  static constexpr size_t CHUNK = 1 << 20; //grow the mapping by 1MB at least. only the part within the file is accessed
+  static constexpr size_t RESERVE = size_t(1) << 31; //as index is int, the file never exceeds 2GB
+
+  int &empty() {
+    return *reinterpret_cast<int *>(base + INFO_LEN);
+  }
+
+  void grow(size_t need) { //extend the file to need and make sure [0, need) is mapped
+    if (ftruncate(fd, static_cast<off_t>(need)) != 0) {
+      throw Error("Cannot extend " + fileName);
+    }
+    if (need <= mapped) {
+      return;
+    }
+    size_t size = std::max(need, mapped + CHUNK);
+    size = (size + CHUNK - 1) / CHUNK * CHUNK;
+    if (mmap(base + mapped, size - mapped, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd,
+             static_cast<off_t>(mapped)) == MAP_FAILED) {
+      throw Error("Cannot map " + fileName);
+    }
+    mapped = size;
+  }
+
+public:
+  explicit MappedStorage(const string &file_name, BufferPool &pool = bufferPool)
+      : fileName("storage/" + file_name + ".dat"), pool(pool) {
+    FileStorage<T, INFO>::create(fileName);
+    fd = open(fileName.c_str(), O_RDWR);
+    void *p = mmap(nullptr, RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (fd < 0 || p == MAP_FAILED) {
+      throw Error("Cannot map " + fileName);
+    }
+    base = static_cast<char *>(p);
+    end = static_cast<int>(std::filesystem::file_size(fileName));
+    aligned = end % alignof(T) == 0; //all objects are at the same offset modulo the alignment
+    grow(end);
+  }
+
+  ~MappedStorage() override {
+    pool.release(this);
+    munmap(base, RESERVE);
+    close(fd);
+  }
+
+  void writePage(int index, const char *data) override {
+    std::memcpy(base + index, data, T_SIZE);
+  }
+
+  void flush() {
+    pool.flush(this);
+    msync(base, end, MS_SYNC);
+  }
+
+  void clear() { //remove all objects and truncate the file. info is kept
+    pool.release(this, false);
+    if (ftruncate(fd, START) != 0) { //objects added later are zeroed when the file is extended
+      throw Error("Cannot truncate " + fileName);
+    }
+    aligned = true;
+    empty() = end = START;
+  }
+
+  static constexpr int start() { //index of the first object
+    return START;
+  }
+
+  [[nodiscard]] int size() const { //logical size of the file in bytes
+    return end;
+  }
+
+  INFO getInfo() {
+    INFO ret;
+    std::memcpy(static_cast<void *>(&ret), base, INFO_LEN);
+    return ret;
+  }
+
+  void setInfo(const INFO &info) { //written in place, so containers call it whenever their info changes
+    std::memcpy(base, &info, INFO_LEN);
+  }
+
+  //find an empty place for a new object and return its index. the object should be filled by set or pin
+  int add() {
+    int index = empty();
+    int nxt;
+    if (index >= end) {
+      nxt = index + T_SIZE;
+      grow(nxt);
+      end = nxt;
+    } else {
+      std::memcpy(&nxt, base + index, INT_SIZE);
+    }
+    empty() = nxt;
+    return index;
+  }
+
+  //find an empty place to add T and return the index of the object
+  int add(const T &t) {
+    int index = add();
+    set(t, index);
+    return index;
+  }
+
+  //make sure the index is valid
+  //update the object at index
+  void set(const T &t, int index) {
+    char *page = aligned ? nullptr : pool.find(this, index);
+    if (page != nullptr) {
+      std::memcpy(page, &t, T_SIZE);
+      pool.markDirty(this, index);
+    } else {
+      std::memcpy(base + index, &t, T_SIZE);
+    }
+  }
+
+  //make sure the index is valid
+  //return the object at index
+  T get(int index) {
+    char *page = aligned ? nullptr : pool.find(this, index);
+    T ret;
+    std::memcpy(static_cast<void *>(&ret), page != nullptr ? page : base + index, T_SIZE);
+    return ret;
+  }
+
+  //make sure the cnt objects from index are valid and contiguous
+  //copy them to out. dirty cached objects are written back first
+  void read(int index, int cnt, T *out) {
+    if (!aligned) {
+      pool.flush(this);
+    }
+    std::memcpy(reinterpret_cast<char *>(out), base + index, static_cast<size_t>(cnt) * T_SIZE);
+  }
+
+  //make sure the index is valid
+  //return the object at index in place, which stays valid until unpin is called
+  T &pin(int index) {
+    if (aligned) {
+      return *reinterpret_cast<T *>(base + index);
+    }
+    char *page = pool.find(this, index);
+    if (page == nullptr) {
+      page = pool.insert(this, index, T_SIZE);
+      std::memcpy(page, base + index, T_SIZE);
+    }
+    pool.pin(this, index);
+    return *reinterpret_cast<T *>(page);
+  }
+
+  //make sure the index is pinned
+  //set dirty if the object has been modified
+  void unpin(int index, bool dirty) {
+    if (!aligned) {
+      pool.unpin(this, index, dirty);
+    }
+  }
+
+  //make sure the index is valid
+  //delete a currently occupied index
+  //you should never remove an empty index!
+  void remove(int index) {
+    if (!aligned) {
+      pool.discard(this, index);
+    }
+    std::memcpy(base + index, &empty(), INT_SIZE);
+    empty() = index;
+  }
+};
+
+#ifdef BOOKSTORE_MMAP
+template<class T, class INFO>
+using Storage = MappedStorage<T, INFO>;
+#else
+template<class T, class INFO>
+using Storage = FileStorage<T, INFO>;
+#endif
+
+#endif //BOOKSTORE_MAPPED_STORAGE_HPP
@@ -0,0 +1,407 @@
+//
+// Created by zjx on 2024/1/13.
+//
+
+#ifndef BOOKSTORE_PERSISTENT_HASH_HPP
+#define BOOKSTORE_PERSISTENT_HASH_HPP
+
+#include <algorithm>
+#include <concepts>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include "Error.hpp"
+#include "MappedStorage.hpp"
+#include "BloomFilter.hpp"
+
+template<class KEY, class VALUE, int SIZE, int BLOOM_BITS = 0> //SIZE is the max size of a bucket
+//BLOOM_BITS is the size of the bloom filter of each bucket, 0 to disable
+class PersistentHashMap {
+  //behave like std::unordered_map with unique keys. an extendible hash table, so a lookup reads a single bucket
+  //the directory is loaded into memory when opened and saved to pages of the same file whenever it changes
+  //the bloom filters of buckets are kept in memory and only saved after it when closed, so a lookup ruled out by the filter
+  //of its bucket reads nothing, and a table not closed properly has its filters rebuilt from the buckets
+  typedef std::pair<KEY, VALUE> T;
+
+  struct Bucket {
+    int depth; //number of low bits of hash shared by all keys in the bucket
+    int size;
+    T data[SIZE];
+
+    [[nodiscard]] int find(const KEY &k) const { //-1 if not found
+      for (int i = 0; i < size; i++) {
+        if (data[i].first == k) {
+          return i;
+        }
+      }
+      return -1;
+    }
+  };
+
+  static constexpr int DIR_SIZE = static_cast<int>((sizeof(Bucket) - 2 * sizeof(int)) / sizeof(int));
+
+  struct DirPage { //a part of the directory, which is followed by the bloom filters
+    int next; //-1 if last
+    int size;
+    int data[DIR_SIZE];
+  };
+
+  struct Page {
+    alignas(Bucket) alignas(DirPage) char raw[std::max(sizeof(Bucket), sizeof(DirPage))];
+
+    Bucket &bucket() {
+      return *reinterpret_cast<Bucket *>(raw);
+    }
+
+    DirPage &dir() {
+      return *reinterpret_cast<DirPage *>(raw);
+    }
+  };
+
+  static constexpr int MAGIC = 0x31485845; //"EXH1"
+  static constexpr int MAX_DEPTH = 24;
+
+  struct Info {
+    int magic = MAGIC;
+    int depth = 0; //the directory has 2^depth entries
+    int buckets = 0;
+    int dir = -1; //the first directory page
+  };
+
+  string name;
+  Storage<Page, Info> storage;
+  Info info;
+  std::vector<int> directory; //position of the bucket for each value of the low depth bits of hash
+
+  typedef BloomFilter<BLOOM_BITS> Filter;
+  static constexpr int FILTER_WORDS = sizeof(Filter) / sizeof(int); //ints taking a filter in directory pages
+  std::vector<Filter> filters; //the filter of each bucket by page number. empty if BLOOM_BITS is 0
+  BloomStats bloomStats;
+
+  static uint64_t hash(const KEY &k) {
+    return mixHash(bloomHash(k));
+  }
+
+  Filter &filterOf(int pos) {
+    size_t page = (pos - Storage<Page, Info>::start()) / sizeof(Page);
+    if (page >= filters.size()) {
+      filters.resize(page + 1, Filter{});
+    }
+    return filters[page];
+  }
+
+  //filters are given hash(k) rather than the hash of k, as they mix it again. keys in a bucket share the low bits of hash(k)
+  void fill(int pos, const Bucket &bucket) { //rebuild the filter of the bucket at pos
+    if constexpr (BLOOM_BITS > 0) {
+      Filter &filter = filterOf(pos);
+      filter.clear();
+      for (int i = 0; i < bucket.size; i++) {
+        filter.add(hash(bucket.data[i].first));
+      }
+    }
+  }
+
+  bool mayContain(int pos, uint64_t h) { //false if the filter of the bucket at pos rules out keys with hash h
+    if constexpr (BLOOM_BITS > 0) {
+      bloomStats.checks++;
+      if (!filterOf(pos).mayContain(h)) {
+        bloomStats.negatives++;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void missed() { //a key passing the filter is not found in the bucket
+    if constexpr (BLOOM_BITS > 0) {
+      bloomStats.falsePositives++;
+    }
+  }
+
+  //position of the bucket where keys with hash h should be. callers hash a key once for locate and the filter
+  [[nodiscard]] int locate(uint64_t h) const {
+    return directory[h & ((uint64_t(1) << info.depth) - 1)];
+  }
+
+  void init() { //create the directory with a single empty bucket
+    int pos = storage.add();
+    Bucket &bucket = storage.pin(pos).bucket();
+    bucket.depth = bucket.size = 0;
+    fill(pos, bucket);
+    storage.unpin(pos, true);
+    info.depth = 0;
+    info.buckets = 1;
+    directory.assign(1, pos);
+    save(false);
+  }
+
+  //the directory, then BLOOM_BITS and the filters if the table was closed properly. filters are rebuilt if missing or of
+  //another size. saved filters are dropped from the file at once, as they go stale with the first change
+  void load() {
+    std::vector<int> words;
+    for (int pos = info.dir; pos >= 0;) {
+      const DirPage &page = storage.pin(pos).dir();
+      words.insert(words.end(), page.data, page.data + page.size);
+      int next = page.next;
+      storage.unpin(pos, false);
+      pos = next;
+    }
+    size_t n = words.empty() ? 0 : size_t(1) << info.depth;
+    directory.assign(words.begin(), words.begin() + n);
+    if constexpr (BLOOM_BITS > 0) {
+      if (words.size() > n && words[n] == BLOOM_BITS && (words.size() - n - 1) % FILTER_WORDS == 0) {
+        filters.resize((words.size() - n - 1) / FILTER_WORDS);
+        std::memcpy(filters.data(), words.data() + n + 1, filters.size() * sizeof(Filter));
+      } else {
+        for (int i = 0; i < static_cast<int>(directory.size()); i++) {
+          int pos = directory[i];
+          const Bucket &bucket = storage.pin(pos).bucket();
+          if ((i & ((1 << bucket.depth) - 1)) == i) { //the first directory entry referring to the bucket
+            fill(pos, bucket);
+          }
+          storage.unpin(pos, false);
+        }
+      }
+    }
+    if (words.size() > n) {
+      save(false);
+    }
+  }
+
+  //write the directory, and the filters if withFilters, to new pages before freeing the old ones
+  //so that the file always has a whole directory agreeing with the buckets
+  void save(bool withFilters) {
+    std::vector<int> words(directory);
+    if constexpr (BLOOM_BITS > 0) {
+      if (withFilters) {
+        words.push_back(BLOOM_BITS);
+        words.resize(words.size() + filters.size() * FILTER_WORDS);
+        std::memcpy(words.data() + directory.size() + 1, filters.data(), filters.size() * sizeof(Filter));
+      }
+    }
+    int old = info.dir;
+    info.dir = -1;
+    for (int end = static_cast<int>(words.size()); end > 0; end -= DIR_SIZE) { //from the last page so next is known
+      int begin = std::max(0, end - DIR_SIZE);
+      int pos = storage.add();
+      DirPage &page = storage.pin(pos).dir();
+      page.next = info.dir;
+      page.size = end - begin;
+      std::copy(words.begin() + begin, words.begin() + end, page.data);
+      storage.unpin(pos, true);
+      info.dir = pos;
+    }
+    storage.setInfo(info);
+    for (int pos = old; pos >= 0;) {
+      int next = storage.pin(pos).dir().next;
+      storage.unpin(pos, false);
+      storage.remove(pos);
+      pos = next;
+    }
+  }
+
+  void split(uint64_t h) { //split the full bucket where keys with hash h should be, doubling the directory if needed
+    int pos = locate(h);
+    Bucket &bucket = storage.pin(pos).bucket();
+    if (bucket.depth == info.depth) {
+      if (info.depth == MAX_DEPTH) {
+        storage.unpin(pos, false);
+        throw Error("Hash table is too deep");
+      }
+      size_t n = directory.size(); //the new half refers to the same buckets
+      directory.resize(2 * n);
+      std::copy_n(directory.begin(), n, directory.begin() + n);
+      info.depth++;
+    }
+    uint64_t bit = uint64_t(1) << bucket.depth;
+    int newPos = storage.add();
+    Bucket &newBucket = storage.pin(newPos).bucket();
+    newBucket.depth = ++bucket.depth;
+    newBucket.size = 0;
+    int size = 0;
+    for (int i = 0; i < bucket.size; i++) {
+      if (hash(bucket.data[i].first) & bit) {
+        newBucket.data[newBucket.size++] = bucket.data[i];
+      } else {
+        bucket.data[size++] = bucket.data[i];
+      }
+    }
+    bucket.size = size;
+    fill(pos, bucket);
+    fill(newPos, newBucket);
+    storage.unpin(newPos, true);
+    storage.unpin(pos, true);
+    for (int i = 0; i < static_cast<int>(directory.size()); i++) {
+      if (directory[i] == pos && (i & bit)) {
+        directory[i] = newPos;
+      }
+    }
+    info.buckets++;
+    save(false);
+  }
+
+public:
+  explicit PersistentHashMap(const string &file_name) : name(file_name), storage(file_name) {
+    info = storage.getInfo();
+    if (info.magic != MAGIC) {
+      throw Error("Bad hash table " + file_name);
+    }
+    load();
+    if (directory.empty()) {
+      init();
+    }
+  }
+
+  ~PersistentHashMap() {
+    if constexpr (BLOOM_BITS > 0) {
+      save(true);
+    }
+  }
+
+  template<std::invocable F>
+  bool insertIfAbsent(const KEY &k, F &&make) { //make() creates the value, called only if k is absent. return true if inserted
+    uint64_t h = hash(k);
+    while (true) {
+      int pos = locate(h);
+      Bucket &bucket = storage.pin(pos).bucket();
+      if (bucket.find(k) >= 0) {
+        storage.unpin(pos, false);
+        return false;
+      }
+      if (bucket.size < SIZE) {
+        bucket.data[bucket.size++] = std::make_pair(k, static_cast<VALUE>(make()));
+        storage.unpin(pos, true);
+        if constexpr (BLOOM_BITS > 0) {
+          filterOf(pos).add(h);
+        }
+        return true;
+      }
+      storage.unpin(pos, false);
+      split(h);
+    }
+  }
+
+  bool insertIfAbsent(const KEY &k, const VALUE &v) { //return true if inserted
+    return insertIfAbsent(k, [&v]() {
+      return v;
+    });
+  }
+
+  bool put(const KEY &k, const VALUE &v) { //return true if put successfully
+    return insertIfAbsent(k, v);
+  }
+
+  void upsert(const KEY &k, const VALUE &v) { //insert or overwrite the value of k
+    if (!update(k, [&v](VALUE &value) {
+      value = v;
+    })) {
+      insertIfAbsent(k, v);
+    }
+  }
+
+  bool update(const KEY &k, const std::function<void(VALUE &)> &f) { //modify the value of k in place. false if not found
+    uint64_t h = hash(k);
+    int pos = locate(h);
+    if (!mayContain(pos, h)) {
+      return false;
+    }
+    Bucket &bucket = storage.pin(pos).bucket();
+    int p = bucket.find(k);
+    if (p >= 0) {
+      f(bucket.data[p].second);
+    } else {
+      missed();
+    }
+    storage.unpin(pos, p >= 0);
+    return p >= 0;
+  }
+
+  //return true if remove successfully. buckets are not merged and filters keep the key, but compact() rebuilds the table
+  bool remove(const KEY &k) {
+    uint64_t h = hash(k);
+    int pos = locate(h);
+    if (!mayContain(pos, h)) {
+      return false;
+    }
+    Bucket &bucket = storage.pin(pos).bucket();
+    int p = bucket.find(k);
+    if (p >= 0) {
+      bucket.data[p] = bucket.data[--bucket.size];
+    } else {
+      missed();
+    }
+    storage.unpin(pos, p >= 0);
+    return p >= 0;
+  }
+
+  VALUE get(const KEY &k) { //return the value of the key. return min() if not found
+    uint64_t h = hash(k);
+    int pos = locate(h);
+    if (!mayContain(pos, h)) {
+      return VALUE::min();
+    }
+    const Bucket &bucket = storage.pin(pos).bucket();
+    int p = bucket.find(k);
+    if (p < 0) {
+      missed();
+    }
+    VALUE ret = p >= 0 ? bucket.data[p].second : VALUE::min();
+    storage.unpin(pos, false);
+    return ret;
+  }
+
+  void iterate(const std::function<void(const KEY &, const VALUE &)> &f) { //all elements in no particular order
+    for (int i = 0; i < static_cast<int>(directory.size()); i++) {
+      int pos = directory[i];
+      const Bucket &bucket = storage.pin(pos).bucket();
+      if ((i & ((1 << bucket.depth) - 1)) == i) { //the first directory entry referring to the bucket
+        for (int j = 0; j < bucket.size; j++) {
+          f(bucket.data[j].first, bucket.data[j].second);
+        }
+      }
+      storage.unpin(pos, false);
+    }
+  }
+
+  long long compact() { //rebuild the table so that no bucket is split more than needed. return the bytes reclaimed
+    int before = storage.size();
+    string tmpName = "storage/" + name + ".compact.tmp";
+    long long cnt = 0;
+    {
+      ofstream out(tmpName, std::ios::binary);
+      iterate([&out, &cnt](const KEY &k, const VALUE &v) {
+        T t = std::make_pair(k, v);
+        out.write(reinterpret_cast<const char *>(&t), sizeof(T));
+        cnt++;
+      });
+    }
+    storage.clear();
+    info = Info{};
+    filters.clear();
+    init();
+    {
+      ifstream in(tmpName, std::ios::binary);
+      T t;
+      for (long long i = 0; i < cnt; i++) {
+        in.read(reinterpret_cast<char *>(&t), sizeof(T));
+        insertIfAbsent(t.first, t.second);
+      }
+    }
+    std::filesystem::remove(tmpName);
+    return before - storage.size();
+  }
+
+  [[nodiscard]] int depth() const {
+    return info.depth;
+  }
+
+  [[nodiscard]] int buckets() const {
+    return info.buckets;
+  }
+
+  [[nodiscard]] const BloomStats &stats() const {
+    return bloomStats;
+  }
+};
+
+#endif //BOOKSTORE_PERSISTENT_HASH_HPP
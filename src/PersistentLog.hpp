@@ -0,0 +1,201 @@
+//
+// Created by zjx on 2024/1/15.
+//
+
+#ifndef BOOKSTORE_PERSISTENT_LOG_HPP
+#define BOOKSTORE_PERSISTENT_LOG_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "MappedStorage.hpp"
+#include "Error.hpp"
+
+class PersistentLog {
+  //an append-only log of time-stamped strings of any length, stored without padding in fixed-size segments of a single file
+  //in a segment, the records grow from the front and the offset of each record grows from the back
+  //a record is its time followed by the text. times never decrease, so the first time of each segment is a sparse index
+  //a text too long for a segment is split into pieces in consecutive segments, each marked to continue but the last
+  //segments are appended through the buffer pool and scanned in batches with a single read
+  static constexpr int SEGMENT_SIZE = 32 << 10; //so that offsets fit in 15 bits
+  static constexpr uint16_t CONTINUED = 0x8000; //the top bit of an offset marks a piece continued in the next segment
+
+  struct Segment {
+    int count;
+    int used; //bytes of records
+    char data[SEGMENT_SIZE - 2 * sizeof(int)];
+
+    static constexpr int CAPACITY = sizeof(data);
+
+    [[nodiscard]] uint16_t entry(int i) const { //offset of the i-th record with the flag
+      uint16_t ret;
+      std::memcpy(&ret, data + CAPACITY - (i + 1) * sizeof(uint16_t), sizeof(uint16_t));
+      return ret;
+    }
+
+    [[nodiscard]] int offset(int i) const { //start of the i-th record. the end of the last one is used
+      return i == count ? used : entry(i) & ~CONTINUED;
+    }
+
+    [[nodiscard]] bool continued(int i) const { //whether the text goes on in the first record of the next segment
+      return entry(i) & CONTINUED;
+    }
+
+    [[nodiscard]] std::string_view record(int i) const { //the time followed by the text
+      return {data + offset(i), static_cast<size_t>(offset(i + 1) - offset(i))};
+    }
+
+    [[nodiscard]] long long time(int i) const {
+      long long ret;
+      std::memcpy(&ret, data + offset(i), sizeof(long long));
+      return ret;
+    }
+
+    [[nodiscard]] std::string_view text(int i) const {
+      return record(i).substr(sizeof(long long));
+    }
+
+    [[nodiscard]] bool fits(size_t len) const {
+      return used + sizeof(long long) + len + (count + 1) * sizeof(uint16_t) <= CAPACITY;
+    }
+
+    void append(long long time, std::string_view s, bool continued) { //make sure it fits
+      auto start = static_cast<uint16_t>(used | (continued ? CONTINUED : 0));
+      std::memcpy(data + CAPACITY - (count + 1) * sizeof(uint16_t), &start, sizeof(uint16_t));
+      std::memcpy(data + used, &time, sizeof(long long));
+      std::memcpy(data + used + sizeof(long long), s.data(), s.size());
+      used += static_cast<int>(sizeof(long long) + s.size());
+      count++;
+    }
+  };
+
+  static constexpr int MAGIC = 0x32474F4C; //"LOG2"
+  static constexpr int STEP = sizeof(Segment);
+  static constexpr int BATCH = 32; //segments read at once when iterating
+  static constexpr int MAX_LENGTH = Segment::CAPACITY - sizeof(long long) - sizeof(uint16_t); //longer texts are split
+
+  struct Info {
+    int magic = MAGIC;
+    int size = 0; //number of records
+    int first = -1; //segments are never removed, so they are contiguous from first to last
+    int last = -1;
+  };
+
+  Storage<Segment, Info> storage;
+  Info info;
+
+  void scan(int pos, long long since, long long until, const std::function<void(std::string_view)> &f) {
+    //records with time in [since, until) from the segment at pos on. pieces of a split record share its time
+    std::vector<Segment> buffer;
+    std::string pending; //the pieces read so far of a split record
+    for (int begin = pos; begin >= 0 && begin <= info.last;) {
+      int n = std::min(BATCH, (info.last - begin) / STEP + 1);
+      buffer.resize(n);
+      storage.read(begin, n, buffer.data());
+      for (int j = 0; j < n; j++) {
+        for (int i = 0; i < buffer[j].count; i++) {
+          long long time = buffer[j].time(i);
+          if (time >= until) {
+            return;
+          }
+          if (time < since) {
+            continue;
+          }
+          if (buffer[j].continued(i)) {
+            pending += buffer[j].text(i);
+          } else if (!pending.empty()) {
+            pending += buffer[j].text(i);
+            f(pending);
+            pending.clear();
+          } else {
+            f(buffer[j].text(i));
+          }
+        }
+      }
+      begin += n * STEP;
+    }
+  }
+
+  long long firstTime(int pos) { //time of the first record in the segment at pos
+    const Segment &segment = storage.pin(pos);
+    long long ret = segment.time(0);
+    storage.unpin(pos, false);
+    return ret;
+  }
+
+public:
+  explicit PersistentLog(const string &file_name, BufferPool &pool = bufferPool)
+      : storage(file_name, pool) {
+    info = storage.getInfo();
+    if (info.magic != MAGIC) {
+      throw Error("Bad log " + file_name);
+    }
+  }
+
+  [[nodiscard]] int size() const {
+    return info.size;
+  }
+
+  //time is raised to that of the last record if earlier. a text that doesn't fit in the last segment starts a new one,
+  //and is split into pieces of MAX_LENGTH if still too long
+  void push_back(long long time, std::string_view s) {
+    info.size++;
+    if (info.last >= 0) {
+      Segment &segment = storage.pin(info.last);
+      time = std::max(time, segment.time(segment.count - 1));
+      bool fits = segment.fits(s.size());
+      if (fits) {
+        segment.append(time, s, false);
+      }
+      storage.unpin(info.last, fits);
+      if (fits) {
+        storage.setInfo(info);
+        return;
+      }
+    }
+    while (true) {
+      info.last = storage.add();
+      if (info.first < 0) {
+        info.first = info.last;
+      }
+      bool continued = s.size() > MAX_LENGTH;
+      Segment &segment = storage.pin(info.last);
+      segment.count = segment.used = 0;
+      segment.append(time, s.substr(0, MAX_LENGTH), continued);
+      storage.unpin(info.last, true);
+      if (!continued) {
+        storage.setInfo(info);
+        return;
+      }
+      s.remove_prefix(MAX_LENGTH);
+    }
+  }
+
+  void iterateFromBegin(const std::function<void(std::string_view)> &f) {
+    scan(info.first, std::numeric_limits<long long>::min(), std::numeric_limits<long long>::max(), f);
+  }
+
+  void iterateBetween(long long since, long long until, const std::function<void(std::string_view)> &f) {
+    //records with time in [since, until). the first segment to read is found by binary search on the first times
+    if (info.first < 0) {
+      return;
+    }
+    int low = 0, high = (info.last - info.first) / STEP; //the last segment starting before since, or the first one
+    while (low < high) {
+      int mid = (low + high + 1) / 2;
+      if (firstTime(info.first + mid * STEP) < since) {
+        low = mid;
+      } else {
+        high = mid - 1;
+      }
+    }
+    scan(info.first + low * STEP, since, until, f);
+  }
+};
+
+#endif //BOOKSTORE_PERSISTENT_LOG_HPP
@@ -6,14 +6,27 @@
 #define BOOKSTORE_PERSISTENT_SET_HPP
 
 #include <algorithm>
+#include <concepts>
 #include <cstring>
+#include <iterator>
+#include <type_traits>
+#include <vector>
 #include "Error.hpp"
-#include "FileStorage.hpp"
+#include "MappedStorage.hpp"
 
 template<class T, int BLOCK_SIZE>
 struct Block {
+  //elements are moved byte by byte as they are read from and written to files. std::pair is not trivially copyable only
+  //because of its assignment, so trivial copy construction and destruction are required instead
+  static_assert(std::is_trivially_copy_constructible_v<T> && std::is_trivially_destructible_v<T>);
+
   int size;
   T data[BLOCK_SIZE]; //sorted
+
+  static void move(T *to, const T *from, int cnt) { //the ranges may overlap
+    std::memmove(static_cast<void *>(to), from, cnt * sizeof(T));
+  }
+
   [[nodiscard]] bool empty() const {
     return size <= 0;
   }
@@ -30,7 +43,7 @@ struct Block {
     if (p < size && data[p] == t) { //first check if already exists, use p < size to avoid overflow
       return false;
     }
-    std::memmove(data + p + 1, data + p, (size - p) * sizeof(T));
+    move(data + p + 1, data + p, size - p);
     data[p] = t;
     size++;
     return true;
@@ -41,7 +54,7 @@ struct Block {
     if (p >= size || data[p] != t) {
       return false;
     }
-    std::memmove(data + p, data + p + 1, (size - p) * sizeof(T));
+    move(data + p, data + p + 1, size - p - 1);
     size--;
     return true;
   }
@@ -67,19 +80,40 @@ struct Block {
     return data[0];
   }
 
-  Block split() { //split out a new one and half self
-    Block ret;
+  bool merge(Block &right) { //merge right into self if they fit, otherwise even them out. return whether merged
+    if (size + right.size < BLOCK_SIZE) {
+      move(data + size, right.data, right.size);
+      size += right.size;
+      right.size = 0;
+      return true;
+    }
+    int target = (size + right.size) / 2;
+    if (size < target) { //borrow from right
+      int cnt = target - size;
+      move(data + size, right.data, cnt);
+      move(right.data, right.data + cnt, right.size - cnt);
+      size += cnt;
+      right.size -= cnt;
+    } else { //lend to right
+      int cnt = size - target;
+      move(right.data + cnt, right.data, right.size);
+      move(right.data, data + target, cnt);
+      size -= cnt;
+      right.size += cnt;
+    }
+    return false;
+  }
+
+  void split(Block &ret) { //split the upper half out into ret
     ret.size = size / 2;
     size -= ret.size;
-    std::memmove(ret.data, data + size, ret.size * sizeof(T));
-    return ret;
+    move(ret.data, data + size, ret.size);
   }
 };
 
-template<class T, int SIZE> //SIZE is the max size of indexBlock and currentBlock
-//TODO: maintain the size of each block more properly to optimize time and space usage
+template<class T, int SIZE> //SIZE is the max size of a leaf. internal nodes are stored in pages of the same size
 class PersistentSet {
-  //behave like std::set
+  //behave like std::set. a B+ tree whose leaves are linked in order
   struct Index {
     T min;
     int pos;
@@ -93,89 +127,504 @@ class PersistentSet {
     };
   };
 
-  Block<Index, SIZE> indexBlock; //can be cached and stored when destructed
-  Block<T, SIZE> currentBlock; //temp
-  FileStorage<decltype(currentBlock), decltype(indexBlock)> storage;
+  struct Leaf : public Block<T, SIZE> {
+    int prev; //-1 if first
+    int next; //-1 if last
+  };
+
+  static constexpr int INDEX_SIZE = std::max(4, static_cast<int>(sizeof(Leaf) / sizeof(Index)));
+  typedef Block<Index, INDEX_SIZE> Internal;
 
-public:
-  explicit PersistentSet(const string &file_name) : storage(file_name) {
-    indexBlock = storage.getInfo();
+  struct Node { //a page of the tree. whether it is a leaf is determined by its depth
+    alignas(Leaf) alignas(Internal) char raw[std::max(sizeof(Leaf), sizeof(Internal))];
+
+    Leaf &leaf() {
+      return *reinterpret_cast<Leaf *>(raw);
+    }
+
+    Internal &internal() {
+      return *reinterpret_cast<Internal *>(raw);
+    }
+  };
+
+  static constexpr int MERGE_RATE = 4; //a node with less than 1 / MERGE_RATE of capacity is merged with or borrows from a sibling
+  static constexpr int MAGIC = 0x31545042; //"BPT1", to tell from the old two-level layout whose info starts with a size
+
+  struct Info {
+    int magic = MAGIC;
+    int root = -1;
+    int height = 0; //0 if empty. leaves are at depth height - 1
+    int first = -1; //the first leaf
+  };
+
+  struct Step { //an internal node on the path from root and the id of the child taken
+    int pos;
+    int id;
+  };
+
+  struct LegacyIndex { //index of the old two-level layout
+    T min;
+    int pos;
+  };
+
+  string name;
+  Storage<Node, Info> storage;
+  Info info;
+  std::vector<Step> path; //filled by findLeaf
+
+  static string prepare(const string &file_name) { //move a file of the old layout aside to be migrated
+    string fileName = "storage/" + file_name + ".dat";
+    if (std::filesystem::exists(fileName)) {
+      int magic = 0;
+      ifstream(fileName, std::ios::binary).read(reinterpret_cast<char *>(&magic), sizeof(int));
+      if (magic != MAGIC) {
+        std::filesystem::rename(fileName, "storage/" + file_name + ".legacy.dat");
+      }
+    }
+    return file_name;
+  }
+
+  void migrate(const string &file_name) { //insert all the data in the old two-level layout
+    string fileName = "storage/" + file_name + ".legacy.dat";
+    if (!std::filesystem::exists(fileName)) {
+      return;
+    }
+    {
+      Storage<Block<T, SIZE>, Block<LegacyIndex, SIZE>> legacy(file_name + ".legacy");
+      Block<LegacyIndex, SIZE> indexBlock = legacy.getInfo();
+      for (int i = 0; i < indexBlock.size; i++) {
+        int pos = indexBlock.data[i].pos;
+        const Block<T, SIZE> &block = legacy.pin(pos);
+        for (int j = 0; j < block.size; j++) {
+          insert(block.data[j]);
+        }
+        legacy.unpin(pos, false);
+      }
+    }
+    std::filesystem::remove(fileName);
   }
 
-  ~PersistentSet() {
-    storage.setInfo(indexBlock);
+  static int childOf(const Internal &node, const T &t) { //the last child whose min is no greater than t, or the first
+    int id = static_cast<int>(std::upper_bound(node.data, node.data + node.size, t, [](const T &a, const Index &b) {
+      return a < b.min;
+    }) - node.data) - 1;
+    return std::max(0, id);
   }
 
-  bool insert(const T &t) {
-    if (indexBlock.empty()) { //init
-      currentBlock = {1, {t}};
-      indexBlock.insert({t, storage.add(currentBlock)});
-      return true;
+  int findLeaf(const T &t) { //record the path from root to the leaf where t should be. make sure not empty
+    path.clear();
+    int pos = info.root;
+    for (int depth = 1; depth < info.height; depth++) {
+      const Internal &node = storage.pin(pos).internal();
+      int id = childOf(node, t);
+      int child = node.data[id].pos;
+      storage.unpin(pos, false);
+      path.push_back({pos, id});
+      pos = child;
     }
-    int indexId = indexBlock.getLastNoGreater({t, 0}); //just for cmp. pos is useless
-    Index &index = indexBlock.data[std::max(0, indexId)];
-    currentBlock = storage.get(index.pos);
-    if (!currentBlock.insert(t)) {
-      return false;
+    return pos;
+  }
+
+  void updateMin(int level, const T &min) { //the child taken at path[level] now has min. update upwards
+    for (; level >= 0; level--) {
+      Internal &node = storage.pin(path[level].pos).internal();
+      Index &index = node.data[path[level].id];
+      bool changed = index.min != min;
+      index.min = min;
+      storage.unpin(path[level].pos, changed);
+      if (!changed || path[level].id != 0) { //min of the node doesn't change
+        return;
+      }
     }
-    storage.set(currentBlock, index.pos);
-    index.min = currentBlock.min();
-    if (currentBlock.full()) { //split
-      auto newBlock = currentBlock.split();
-      storage.set(currentBlock, index.pos); //overwrite as currentBlock has changed
-      indexBlock.insert({newBlock.min(), storage.add(newBlock)});
+  }
+
+  void insertIndex(int level, const Index &left, const Index &right) { //right is split out from left, the child taken at path[level]
+    if (level < 0) { //left is the root
+      int pos = storage.add();
+      Internal &root = storage.pin(pos).internal();
+      root.size = 2;
+      root.data[0] = left;
+      root.data[1] = right;
+      storage.unpin(pos, true);
+      info.root = pos;
+      info.height++;
+      return;
     }
-    return true;
+    int pos = path[level].pos;
+    Internal &node = storage.pin(pos).internal();
+    node.insert(right);
+    if (node.full()) { //split
+      int newPos = storage.add();
+      Internal &newNode = storage.pin(newPos).internal();
+      node.split(newNode);
+      Index newLeft{node.min().min, pos}, newRight{newNode.min().min, newPos};
+      storage.unpin(newPos, true);
+      storage.unpin(pos, true);
+      insertIndex(level - 1, newLeft, newRight);
+      return;
+    }
+    storage.unpin(pos, true);
   }
 
-  bool erase(const T &t) {
-    if (indexBlock.empty()) {
-      return false;
+  void removeIndex(int level) { //remove the child taken at path[level], which has been removed
+    if (level < 0) { //the root is removed
+      info = Info{};
+      return;
     }
-    int indexId = indexBlock.getLastNoGreater({t, 0}); //just for cmp. pos is useless
-    if (indexId < 0) {
-      return false;
+    int pos = path[level].pos;
+    Internal &node = storage.pin(pos).internal();
+    node.erase(node.data[path[level].id]);
+    if (node.empty()) {
+      storage.unpin(pos, false);
+      storage.remove(pos);
+      removeIndex(level - 1);
+      return;
+    }
+    T min = node.min().min;
+    bool underfull = node.size < INDEX_SIZE / MERGE_RATE;
+    storage.unpin(pos, true);
+    if (path[level].id == 0) {
+      updateMin(level - 1, min);
+    }
+    if (underfull && level > 0) {
+      rebalance(level - 1);
+    }
+    while (info.height > 1) { //the root with only one child is useless
+      Internal &root = storage.pin(info.root).internal();
+      int child = root.data[0].pos;
+      bool useless = root.size == 1;
+      storage.unpin(info.root, false);
+      if (!useless) {
+        break;
+      }
+      storage.remove(info.root);
+      info.root = child;
+      info.height--;
+    }
+  }
+
+  void rebalance(int level) { //the child taken at path[level] has too few elements. merge it with or borrow from a sibling
+    int pos = path[level].pos;
+    Internal &parent = storage.pin(pos).internal();
+    if (parent.size < 2) {
+      storage.unpin(pos, false);
+      return;
+    }
+    int id = path[level].id + 1 < parent.size ? path[level].id : path[level].id - 1; //balance id and id + 1
+    int leftPos = parent.data[id].pos, rightPos = parent.data[id + 1].pos;
+    Node &left = storage.pin(leftPos), &right = storage.pin(rightPos);
+    bool leaf = level == static_cast<int>(path.size()) - 1;
+    bool merged = leaf ? left.leaf().merge(right.leaf()) : left.internal().merge(right.internal());
+    if (!merged) {
+      parent.data[id + 1].min = leaf ? right.leaf().min() : right.internal().min().min; //min of left doesn't change
+      storage.unpin(rightPos, true);
+      storage.unpin(leftPos, true);
+      storage.unpin(pos, true);
+      return;
     }
-    Index &index = indexBlock.data[indexId];
-    currentBlock = storage.get(index.pos);
-    if (currentBlock.erase(t)) {
-      if (currentBlock.empty()) { //I think delete when empty is the best, as you needn't concern about merging
-        storage.remove(index.pos);
-        indexBlock.erase(index);
+    if (leaf) { //unlink right
+      int next = right.leaf().next;
+      left.leaf().next = next;
+      if (next >= 0) {
+        storage.pin(next).leaf().prev = leftPos;
+        storage.unpin(next, true);
+      }
+    }
+    storage.unpin(rightPos, false);
+    storage.unpin(leftPos, true);
+    storage.unpin(pos, true);
+    storage.remove(rightPos);
+    path[level].id = id + 1;
+    removeIndex(level);
+  }
+
+  void settle(int pos, Leaf &leaf) { //the pinned leaf at pos found by findLeaf has been modified. keep the tree valid and unpin it
+    if (leaf.empty()) { //only happens when the leaf has no sibling to merge with
+      int prev = leaf.prev, next = leaf.next;
+      storage.unpin(pos, false);
+      if (prev >= 0) {
+        storage.pin(prev).leaf().next = next;
+        storage.unpin(prev, true);
       } else {
-        storage.set(currentBlock, index.pos);
-        index.min = currentBlock.min();
+        info.first = next;
       }
-      return true;
+      if (next >= 0) {
+        storage.pin(next).leaf().prev = prev;
+        storage.unpin(next, true);
+      }
+      storage.remove(pos);
+      removeIndex(static_cast<int>(path.size()) - 1);
+      return;
+    }
+    updateMin(static_cast<int>(path.size()) - 1, leaf.min());
+    if (leaf.full()) { //split
+      int newPos = storage.add();
+      Leaf &newLeaf = storage.pin(newPos).leaf();
+      leaf.split(newLeaf);
+      newLeaf.prev = pos;
+      newLeaf.next = leaf.next;
+      if (leaf.next >= 0) {
+        storage.pin(leaf.next).leaf().prev = newPos;
+        storage.unpin(leaf.next, true);
+      }
+      leaf.next = newPos;
+      Index left{leaf.min(), pos}, right{newLeaf.min(), newPos};
+      storage.unpin(newPos, true);
+      storage.unpin(pos, true);
+      insertIndex(static_cast<int>(path.size()) - 1, left, right);
+      return;
+    }
+    bool underfull = leaf.size < SIZE / MERGE_RATE;
+    storage.unpin(pos, true);
+    if (underfull && !path.empty()) {
+      rebalance(static_cast<int>(path.size()) - 1);
     }
-    return false;
   }
 
-  std::vector<T> search(const T &min, const T &max) {
-    std::vector<T> ret;
-    if (indexBlock.empty()) {
-      return ret;
-    }
-    T tmp;
-    int startIndexGlobal = std::max(0, indexBlock.getLastNoGreater({min, 0})); //just for cmp. pos is useless
-    currentBlock = storage.get(indexBlock.data[startIndexGlobal].pos);
-    int startIndexLocal = currentBlock.getFirstNoSmaller(min);
-    for (int i = startIndexLocal; i < currentBlock.size; i++) {
-      tmp = currentBlock.data[i];
-      if (max < tmp) {
-        return ret;
+  long long dump(const string &fileName) { //write all elements in order to a file and return the count
+    long long cnt = 0;
+    ofstream out(fileName, std::ios::binary);
+    for (int pos = info.height > 0 ? info.first : -1; pos >= 0;) {
+      const Leaf &leaf = storage.pin(pos).leaf();
+      out.write(reinterpret_cast<const char *>(leaf.data), leaf.size * static_cast<long long>(sizeof(T)));
+      cnt += leaf.size;
+      int next = leaf.next;
+      storage.unpin(pos, false);
+      pos = next;
+    }
+    return cnt;
+  }
+
+  void build(ifstream &in, long long cnt) { //bulk load cnt sorted elements into an empty tree, packing nodes densely
+    if (cnt == 0) {
+      return;
+    }
+    std::vector<Index> level;
+    long long leaves = (cnt + SIZE - 2) / (SIZE - 1);
+    for (long long i = 0; i < leaves; i++) {
+      int pos = storage.add();
+      Leaf &leaf = storage.pin(pos).leaf();
+      leaf.size = static_cast<int>(cnt / leaves + (i < cnt % leaves));
+      in.read(reinterpret_cast<char *>(leaf.data), leaf.size * static_cast<long long>(sizeof(T)));
+      leaf.prev = level.empty() ? -1 : level.back().pos;
+      leaf.next = -1;
+      level.push_back({leaf.min(), pos});
+      storage.unpin(pos, true);
+      if (leaf.prev >= 0) {
+        storage.pin(leaf.prev).leaf().next = pos;
+        storage.unpin(leaf.prev, true);
+      }
+    }
+    info.first = level.front().pos;
+    info.height = 1;
+    while (level.size() > 1) {
+      std::vector<Index> upper;
+      long long n = static_cast<long long>(level.size()), nodes = (n + INDEX_SIZE - 2) / (INDEX_SIZE - 1);
+      for (long long i = 0, k = 0; i < nodes; i++) {
+        int pos = storage.add();
+        Internal &node = storage.pin(pos).internal();
+        node.size = static_cast<int>(n / nodes + (i < n % nodes));
+        std::copy(level.begin() + k, level.begin() + k + node.size, node.data);
+        k += node.size;
+        upper.push_back({node.min().min, pos});
+        storage.unpin(pos, true);
       }
-      ret.push_back(tmp);
-    } //first eat the current block
-    for (int i = startIndexGlobal + 1; i < indexBlock.size; i++) {
-      currentBlock = storage.get(indexBlock.data[i].pos);
-      for (int j = 0; j < currentBlock.size; j++) {
-        tmp = currentBlock.data[j];
-        if (max < tmp) {
-          return ret;
+      level = std::move(upper);
+      info.height++;
+    }
+    info.root = level.front().pos;
+  }
+
+public:
+  class Iterator { //a forward cursor over [min, max] which pins one leaf at a time. don't modify the set while iterating
+    PersistentSet *set = nullptr;
+    int pos = -1; //-1 if finished
+    int id = 0;
+    const Leaf *leaf = nullptr;
+    T max;
+
+    void skip() { //move to the next leaf if this one is exhausted. finish if max is exceeded
+      while (pos >= 0 && id >= leaf->size) {
+        int next = leaf->next;
+        set->storage.unpin(pos, false);
+        pos = next;
+        id = 0;
+        if (pos >= 0) {
+          leaf = &set->storage.pin(pos).leaf();
         }
-        ret.push_back(tmp);
       }
+      if (pos >= 0 && max < leaf->data[id]) {
+        release();
+      }
+    }
+
+    void release() {
+      if (pos >= 0) {
+        set->storage.unpin(pos, false);
+        pos = -1;
+      }
+    }
+
+  public:
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+
+    Iterator() = default;
+
+    Iterator(PersistentSet *set, int pos, const T &min, const T &max) : set(set), pos(pos), max(max) {
+      if (pos >= 0) {
+        leaf = &set->storage.pin(pos).leaf();
+        id = leaf->getFirstNoSmaller(min);
+        skip();
+      }
+    }
+
+    Iterator(Iterator &&other) noexcept: set(other.set), pos(other.pos), id(other.id), leaf(other.leaf),
+                                         max(other.max) {
+      other.pos = -1;
+    }
+
+    Iterator &operator=(Iterator &&other) noexcept {
+      if (this != &other) {
+        release();
+        set = other.set;
+        pos = other.pos;
+        id = other.id;
+        leaf = other.leaf;
+        max = other.max;
+        other.pos = -1;
+      }
+      return *this;
+    }
+
+    ~Iterator() {
+      release();
+    }
+
+    const T &operator*() const {
+      return leaf->data[id];
+    }
+
+    Iterator &operator++() {
+      id++;
+      skip();
+      return *this;
+    }
+
+    void operator++(int) {
+      ++*this;
+    }
+
+    bool operator==(std::default_sentinel_t) const {
+      return pos < 0;
+    }
+  };
+
+  struct Range { //all elements in [min, max], loaded lazily
+    PersistentSet *set;
+    T min;
+    T max;
+
+    [[nodiscard]] Iterator begin() const {
+      return Iterator(set, set->info.height == 0 ? -1 : set->findLeaf(min), min, max);
+    }
+
+    [[nodiscard]] std::default_sentinel_t end() const {
+      return {};
+    }
+  };
+
+  explicit PersistentSet(const string &file_name) : name(file_name), storage(prepare(file_name)) {
+    info = storage.getInfo();
+    migrate(file_name);
+  }
+
+  //locate the leaf where probe should be and let f modify it in place. return what f returns, i.e. whether modified
+  //f should keep the leaf sorted and change its size by at most one. an element inserted should have the same key as probe
+  template<class F>
+  bool visit(const T &probe, F &&f) {
+    if (info.height == 0) { //init with an empty leaf, which is removed if still empty
+      int pos = storage.add();
+      Leaf &leaf = storage.pin(pos).leaf();
+      leaf.size = 0;
+      leaf.prev = leaf.next = -1;
+      storage.unpin(pos, true);
+      info.root = info.first = pos;
+      info.height = 1;
+    }
+    int pos = findLeaf(probe);
+    Leaf &leaf = storage.pin(pos).leaf(); //modify in place
+    bool modified = f(static_cast<Block<T, SIZE> &>(leaf));
+    if (modified || leaf.empty()) {
+      settle(pos, leaf);
+    } else {
+      storage.unpin(pos, false);
+    }
+    storage.setInfo(info); //at once, so that the root is found if the process is killed
+    return modified;
+  }
+
+  //locate the leaf where probe should be and let f read it. return what f returns, i.e. whether found
+  template<class F>
+  bool peek(const T &probe, F &&f) {
+    if (info.height == 0) {
+      return false;
+    }
+    int pos = findLeaf(probe);
+    bool ret = f(static_cast<const Block<T, SIZE> &>(storage.pin(pos).leaf()));
+    storage.unpin(pos, false);
+    return ret;
+  }
+
+  bool insert(const T &t) {
+    return visit(t, [&t](Block<T, SIZE> &block) {
+      return block.insert(t);
+    });
+  }
+
+  bool erase(const T &t) {
+    if (info.height == 0) {
+      return false;
+    }
+    return visit(t, [&t](Block<T, SIZE> &block) {
+      return block.erase(t);
+    });
+  }
+
+  long long compact() { //rewrite the tree densely and truncate the file. return the bytes reclaimed
+    int before = storage.size();
+    string tmpName = "storage/" + name + ".compact.tmp";
+    long long cnt = dump(tmpName);
+    storage.clear();
+    info = Info{};
+    {
+      ifstream in(tmpName, std::ios::binary);
+      build(in, cnt);
+    }
+    storage.setInfo(info);
+    std::filesystem::remove(tmpName);
+    return before - storage.size();
+  }
+
+  [[nodiscard]] bool empty() const {
+    return info.height == 0;
+  }
+
+  Range range(const T &min, const T &max) {
+    return {this, min, max};
+  }
+
+  bool contains(const T &t) {
+    return peek(t, [&t](const Block<T, SIZE> &block) {
+      int p = block.getFirstNoSmaller(t);
+      return p < block.size && block.data[p] == t;
+    });
+  }
+
+  std::vector<T> search(const T &min, const T &max) {
+    std::vector<T> ret;
+    for (const T &t: range(min, max)) {
+      ret.push_back(t);
     }
     return ret;
   }
@@ -184,16 +633,73 @@ public:
 template<class KEY, class VALUE, int SIZE>
 class PersistentMap : public PersistentSet<std::pair<KEY, VALUE>, SIZE> {
   const bool multi;
+  typedef std::pair<KEY, VALUE> T;
+
+  static int find(const Block<T, SIZE> &block, const KEY &k) { //index of the element with key k in block. -1 if not found
+    int p = static_cast<int>(std::lower_bound(block.data, block.data + block.size, std::make_pair(k, VALUE::min())) -
+                             block.data);
+    return p < block.size && block.data[p].first == k ? p : -1;
+  }
+
+  void requireUnique() const {
+    if (multi) {
+      throw Error("You should use put and remove with value if multi is true");
+    }
+  }
+
 public:
-  explicit PersistentMap(bool multi, const string &file_name) : multi(multi),
-                                                                PersistentSet<std::pair<KEY, VALUE>, SIZE>(file_name) {}
+  explicit PersistentMap(bool multi, const string &file_name) : PersistentSet<std::pair<KEY, VALUE>, SIZE>(file_name),
+                                                                multi(multi) {}
 
   bool put(const KEY &k, const VALUE &v) { //return true if put successfully
     if (multi) {
       return this->insert(std::make_pair(k, v));
     }
-    auto vec = this->search(std::make_pair(k, VALUE::min()), std::make_pair(k, VALUE::max()));
-    return vec.empty() && this->insert(std::make_pair(k, v));
+    return insertIfAbsent(k, v);
+  }
+
+  //the single-pass operations below are for unique maps. as there is at most one element with key k,
+  //the leaf where (k, max) should be is the one containing k if exists
+
+  template<std::invocable F>
+  bool insertIfAbsent(const KEY &k, F &&make) { //make() creates the value, called only if k is absent. return true if inserted
+    requireUnique();
+    return this->visit(std::make_pair(k, VALUE::max()), [&k, &make](Block<T, SIZE> &block) {
+      return find(block, k) < 0 && block.insert(std::make_pair(k, static_cast<VALUE>(make())));
+    });
+  }
+
+  bool insertIfAbsent(const KEY &k, const VALUE &v) { //return true if inserted
+    return insertIfAbsent(k, [&v]() {
+      return v;
+    });
+  }
+
+  void upsert(const KEY &k, const VALUE &v) { //insert or overwrite the value of k
+    requireUnique();
+    this->visit(std::make_pair(k, VALUE::max()), [&k, &v](Block<T, SIZE> &block) {
+      int p = find(block, k);
+      if (p < 0) {
+        return block.insert(std::make_pair(k, v));
+      }
+      block.data[p].second = v; //order is kept as no other element has key k
+      return true;
+    });
+  }
+
+  bool update(const KEY &k, const std::function<void(VALUE &)> &f) { //modify the value of k in place. false if not found
+    requireUnique();
+    if (this->empty()) {
+      return false;
+    }
+    return this->visit(std::make_pair(k, VALUE::max()), [&k, &f](Block<T, SIZE> &block) {
+      int p = find(block, k);
+      if (p < 0) {
+        return false;
+      }
+      f(block.data[p].second); //the order of value doesn't matter as no other element has key k
+      return true;
+    });
   }
 
   bool remove(const KEY &k,
@@ -204,8 +710,13 @@ public:
     if (v != VALUE::min()) {
       return this->erase(std::make_pair(k, v));
     }
-    auto vec = this->search(std::make_pair(k, VALUE::min()), std::make_pair(k, VALUE::max()));
-    return !vec.empty() && this->erase(vec[0]);
+    if (this->empty()) {
+      return false;
+    }
+    return this->visit(std::make_pair(k, VALUE::max()), [&k](Block<T, SIZE> &block) {
+      int p = find(block, k);
+      return p >= 0 && block.erase(block.data[p]);
+    });
   }
 
   VALUE
@@ -213,34 +724,29 @@ public:
     if (multi) {
       throw Error("You should use iterate if multi is true");
     }
-    auto vec = this->search(std::make_pair(k, VALUE::min()), std::make_pair(k, VALUE::max()));
-    if (vec.empty()) {
-      return VALUE::min();
-    }
-    return vec[0].second;
+    VALUE ret = VALUE::min();
+    this->peek(std::make_pair(k, VALUE::max()), [&k, &ret](const Block<T, SIZE> &block) {
+      int p = find(block, k);
+      if (p >= 0) {
+        ret = block.data[p].second;
+      }
+      return p >= 0;
+    });
+    return ret;
   }
 
   void iterate(const KEY &k, const std::function<void(const VALUE &)> &f, const std::function<void()> &emptyF) { //iterate all values of the key
-    const std::vector<std::pair<KEY, VALUE>> &v = this->search(std::make_pair(k, VALUE::min()),
-                           std::make_pair(k, VALUE::max()));
-    if (v.empty()) {
-      emptyF();
-    } else {
-      for (const std::pair<KEY, VALUE> &p: v) {
-        f(p.second);
-      }
-    }
+    iterateAll(k, k, f, emptyF);
   }
 
   void iterateAll(const KEY &k1, const KEY &k2, const std::function<void(const VALUE &)> &f, const std::function<void()> &emptyF) { //iterate all values from k1 to k2
-    const std::vector<std::pair<KEY, VALUE>> &v = this->search(std::make_pair(k1, VALUE::min()),
-                                                               std::make_pair(k2, VALUE::max()));
-    if (v.empty()) {
+    bool empty = true;
+    for (const std::pair<KEY, VALUE> &p: this->range(std::make_pair(k1, VALUE::min()), std::make_pair(k2, VALUE::max()))) {
+      empty = false;
+      f(p.second);
+    }
+    if (empty) {
       emptyF();
-    } else {
-      for (const std::pair<KEY, VALUE> &p: v) {
-        f(p.second);
-      }
     }
   }
 
@@ -5,9 +5,11 @@
 #ifndef BOOKSTORE_PERSISTENT_VECTOR_HPP
 #define BOOKSTORE_PERSISTENT_VECTOR_HPP
 
-#include "FileStorage.hpp"
+#include "MappedStorage.hpp"
 #include "Error.hpp"
+#include <algorithm>
 #include <functional>
+#include <vector>
 
 template<typename T>
 class PersistentVector {
@@ -16,20 +18,35 @@ class PersistentVector {
     int size;
   };
   static constexpr int STEP = sizeof(T);
-  FileStorage<T, Info> storage;
+  static constexpr int BATCH = std::max(1, (1 << 20) / STEP); //records read at once when iterating
+  Storage<T, Info> storage;
   Info info;
+
+  [[nodiscard]] int position(int index) const { //position of the index-th element from the beginning
+    return info.last - (info.size - 1 - index) * STEP;
+  }
+
 public:
   explicit PersistentVector(const string &file_name) : storage(file_name) {
     info = storage.getInfo();
   }
 
-  ~PersistentVector() {
-    storage.setInfo(info);
+  [[nodiscard]] int size() const {
+    return info.size;
+  }
+
+  T get(int index) { //the index-th element from the beginning
+    return storage.get(position(index));
+  }
+
+  T back() {
+    return storage.get(info.last);
   }
 
   void push_back(const T &t) {
     info.size++;
     info.last = storage.add(t);
+    storage.setInfo(info);
   }
 
   void iterate(int cnt, std::function<void(const T &)> f) { //backwards
@@ -39,14 +56,26 @@ public:
     if (cnt == -1) {
       cnt = info.size;
     }
-    for (int i = 0; i < cnt; i++) {
-      f(storage.get(info.last - i * STEP)); //as we never remove, this is safe
+    std::vector<T> buffer(std::min(cnt, BATCH));
+    for (int done = 0; done < cnt;) { //as we never remove, the records are contiguous
+      int n = std::min(cnt - done, BATCH);
+      storage.read(position(info.size - done - n), n, buffer.data());
+      for (int i = n - 1; i >= 0; i--) {
+        f(buffer[i]);
+      }
+      done += n;
     }
   }
 
   void iterateFromBegin(std::function<void(const T &)> f) {
-    for (int i = info.size - 1; i >= 0; i--) {
-      f(storage.get(info.last - i * STEP));
+    std::vector<T> buffer(std::min(info.size, BATCH));
+    for (int done = 0; done < info.size;) {
+      int n = std::min(info.size - done, BATCH);
+      storage.read(position(done), n, buffer.data());
+      for (int i = 0; i < n; i++) {
+        f(buffer[i]);
+      }
+      done += n;
     }
   }
 };
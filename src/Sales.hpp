@@ -0,0 +1,84 @@
+//
+// Created by zjx on 2024/1/14.
+//
+
+#ifndef BOOKSTORE_SALES_HPP
+#define BOOKSTORE_SALES_HPP
+
+#include <climits>
+#include "Utils.hpp"
+#include "Book.hpp"
+#include "PersistentHash.hpp"
+
+struct BookSales { //sales of a book, kept by the position of its record so that changing ISBN doesn't matter
+  int units;
+  Money revenue;
+  int last; //the number of the finance record of the last sale
+
+  [[nodiscard]] bool empty() const {
+    return units == 0;
+  }
+
+  static constexpr BookSales min() {
+    return BookSales{0, Money::min(), 0};
+  }
+};
+
+struct SalesRank { //ordered by units sold descending, then by position
+  int units;
+  int pos;
+
+  auto operator<=>(const SalesRank &rhs) const {
+    return units != rhs.units ? rhs.units <=> units : pos <=> rhs.pos;
+  }
+
+  bool operator==(const SalesRank &rhs) const = default;
+
+  static constexpr SalesRank min() {
+    return SalesRank{INT_MAX, INT_MIN};
+  }
+
+  static constexpr SalesRank max() {
+    return SalesRank{INT_MIN, INT_MAX};
+  }
+};
+
+namespace Sales {
+  PersistentHashMap<int, BookSales, 128> salesMap("sales"); //position of the book record to its sales
+  PersistentSet<SalesRank, 1000> rankSet("bestseller"); //books ever sold, the best first
+
+  void add(int pos, int units, const Money &revenue, int record) { //a sale of the book at pos
+    BookSales sales = salesMap.get(pos);
+    if (!sales.empty()) {
+      rankSet.erase({sales.units, pos});
+    }
+    sales.units += units;
+    sales.revenue += revenue;
+    sales.last = record;
+    salesMap.upsert(pos, sales);
+    rankSet.insert({sales.units, pos});
+  }
+
+  void reportBestsellers(int cnt) { //print ISBN, units, revenue and the last sale of the best cnt books
+    int printed = 0;
+    for (const SalesRank &rank: rankSet.range(SalesRank::min(), SalesRank::max())) {
+      if (printed == cnt) {
+        break;
+      }
+      BookSales sales = salesMap.get(rank.pos);
+      std::cout << Books::bookHeap.get(rank.pos).isbn << '\t' << sales.units << '\t' << sales.revenue << '\t'
+                << sales.last << '\n';
+      printed++;
+    }
+    if (printed == 0) {
+      std::cout << '\n';
+    }
+  }
+
+  void compact() {
+    std::cout << "sales\t" << salesMap.compact() << '\n';
+    std::cout << "bestseller\t" << rankSet.compact() << '\n';
+  }
+}
+
+#endif //BOOKSTORE_SALES_HPP
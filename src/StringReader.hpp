@@ -4,56 +4,63 @@
 
 #ifndef BOOKSTORE_STRING_READER_HPP
 #define BOOKSTORE_STRING_READER_HPP
-#include <vector>
-#include <string>
+#include <string_view>
 class StringReader { //simply use ' ' as delim and provide function to store token back
-  std::vector<std::string> words;
+  //words are views into the line, which must outlive the reader. nothing is copied
+  std::string_view line;
+  size_t cursor = 0; //where to look for the next word
+  std::string_view stored; //a token stored back, returned before the next word
+  bool hasStored = false;
+
+  void skipSpaces() {
+    while (cursor < line.size() && line[cursor] == ' ') {
+      cursor++;
+    }
+  }
+
 public:
   StringReader() = default;
 
-  explicit StringReader(const std::string& s) {
-    bool space = true;
-    std::string tmp;
-    for (char c : s) {
-      if (c == ' ') {
-        if(!space) {
-          words.push_back(tmp);
-          tmp.clear(); //push back the previous word
-        }
-        space = true;
-      } else {
-        tmp.push_back(c);
-        space = false;
-      }
-    }
-    if(!tmp.empty()) {
-      words.push_back(tmp);
-    }
-    std::reverse(words.begin(), words.end());
+  explicit StringReader(std::string_view s) : line(s) {
+    skipSpaces();
   }
 
-  std::string get() {
-    if(words.empty()) {
-      return "";
+  std::string_view get() {
+    if (hasStored) {
+      hasStored = false;
+      return stored;
+    }
+    size_t begin = cursor;
+    while (cursor < line.size() && line[cursor] != ' ') {
+      cursor++;
     }
-    std::string ret = words.back();
-    words.pop_back();
+    std::string_view ret = line.substr(begin, cursor - begin);
+    skipSpaces();
     return ret;
   }
 
-  std::string touch() {
-    if(words.empty()) {
-      return "";
+  std::string_view touch() {
+    if (hasStored) {
+      return stored;
+    }
+    size_t end = cursor;
+    while (end < line.size() && line[end] != ' ') {
+      end++;
     }
-    return words.back();
+    return line.substr(cursor, end - cursor);
+  }
+
+  [[nodiscard]] std::string_view rest() const { //the text not read yet, ignoring a stored token
+    return line.substr(cursor);
   }
 
-  bool empty() {
-    return words.empty();
+  [[nodiscard]] bool empty() const {
+    return !hasStored && cursor == line.size();
   }
 
-  void store(const std::string& s) {
-    words.push_back(s);
+  void store(std::string_view s) { //s should be a view into the line or live as long. only one token is kept
+    stored = s;
+    hasStored = true;
   }
 };
 
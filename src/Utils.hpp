@@ -5,64 +5,163 @@
 #ifndef BOOKSTORE_DATA_TYPES_HPP
 #define BOOKSTORE_DATA_TYPES_HPP
 
+#include <algorithm>
+#include <cstdint>
 #include <cstring>
+#include <cmath>
+#include <ctime>
+#include <charconv>
 #include <map>
+#include <optional>
+#include <string_view>
 #include <ranges>
 #include <variant>
 #include "Error.hpp"
 #include <set>
 #include <iostream>
 #include <iomanip>
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+template<int L>
+class Keywords { //the keywords of a string split by '|', kept inline as (offset, length) into it and sorted without repeats
+  //views into the string, which must outlive this. nothing is allocated
+  struct Part {
+    unsigned short offset, length;
+  };
+
+  const char *base;
+  Part parts[L / 2 + 1]; //each keyword takes at least one character and a '|'
+  int count = 0;
+
+  [[nodiscard]] std::string_view view(const Part &part) const {
+    return {base + part.offset, part.length};
+  }
+
+  void sort() { //throw if any keyword repeats
+    std::sort(parts, parts + count, [this](const Part &a, const Part &b) {
+      return view(a) < view(b);
+    });
+    for (int i = 1; i < count; i++) {
+      if (view(parts[i - 1]) == view(parts[i])) {
+        throw Error("Duplicate keyword!");
+      }
+    }
+  }
+
+public:
+  struct Iterator {
+    const Keywords *list;
+    int i;
+
+    std::string_view operator*() const {
+      return (*list)[i];
+    }
+
+    Iterator &operator++() {
+      i++;
+      return *this;
+    }
+
+    bool operator==(const Iterator &rhs) const = default;
+  };
+
+  Keywords(const char *s, int length) : base(s) { //an empty string has no keywords
+    if (length == 0) {
+      return;
+    }
+    for (const char *begin = s, *end = s + length;; begin++) { //memchr finds each '|' with a vectorized scan
+      auto bar = static_cast<const char *>(std::memchr(begin, '|', end - begin));
+      const char *last = bar == nullptr ? end : bar;
+      if (last == begin) {
+        sort(); //a repeat before the empty keyword is reported first
+        throw Error("Empty keyword!");
+      }
+      parts[count++] = Part{static_cast<unsigned short>(begin - s), static_cast<unsigned short>(last - begin)};
+      if (bar == nullptr) {
+        break;
+      }
+      begin = bar;
+    }
+    sort();
+  }
+
+  [[nodiscard]] int size() const {
+    return count;
+  }
+
+  std::string_view operator[](int i) const {
+    return view(parts[i]);
+  }
+
+  [[nodiscard]] bool contains(std::string_view keyword) const {
+    const Part *it = std::lower_bound(parts, parts + count, keyword, [this](const Part &part, std::string_view k) {
+      return view(part) < k;
+    });
+    return it != parts + count && view(*it) == keyword;
+  }
+
+  [[nodiscard]] Iterator begin() const {
+    return {this, 0};
+  }
+
+  [[nodiscard]] Iterator end() const {
+    return {this, count};
+  }
+};
 
 template<int L>
 class FixedString { // Fixed length string with max length L
   char key[L];
 public:
-  explicit FixedString(const std::string &s) : key{} {
+  explicit FixedString(std::string_view s) : key{} {
     if (s.length() > L) {
       throw Error("String too long, this should never happen!");
     }
-    strncpy(key, s.c_str(), L);
+    std::memcpy(key, s.data(), s.length());
   }
 
-  FixedString() = default;
+  constexpr FixedString() : key{} {} //zeroed as comparison reads all L bytes
 
+  //the unused tail is always zero, so a fixed-width memcmp orders like strncmp and is vectorized by the library
   auto operator<=>(const FixedString &rhs) const {
-    int result = std::strncmp(key, rhs.key, L);
+    int result = std::memcmp(key, rhs.key, L);
     return result < 0 ? std::strong_ordering::less :
            result > 0 ? std::strong_ordering::greater : std::strong_ordering::equal;
   }
 
   bool operator==(const FixedString &rhs) const {
-    return std::strncmp(key, rhs.key, L) == 0;
+    return std::memcmp(key, rhs.key, L) == 0;
   }
 
   [[nodiscard]] int len() const {
     return strnlen(key, L);
   }
 
-  [[nodiscard]] char *begin() const {
+  [[nodiscard]] uint64_t hash() const { //FNV-1a
+    uint64_t ret = 0xcbf29ce484222325ull;
+    for (int i = 0, n = len(); i < n; i++) {
+      ret = (ret ^ static_cast<unsigned char>(key[i])) * 0x100000001b3ull;
+    }
+    return ret;
+  }
+
+  [[nodiscard]] const char *begin() const {
     return key;
   }
 
-  [[nodiscard]] char *end() const {
+  [[nodiscard]] const char *end() const {
     return key + len();
   }
 
   friend std::ostream &operator<<(std::ostream &out, const FixedString &rhs) {
-    for (int i = 0; i < L; i++) {
-      if (rhs.key[i] == '\0') {
-        break;
-      }
-      out << rhs.key[i];
-    }
-    return out;
+    return out.write(rhs.key, rhs.len());
   }
 
   static constexpr FixedString min() {
-    FixedString ret;
-    memset(ret.key, 0, sizeof(ret.key));
-    return ret;
+    return FixedString();
   }
 
   static constexpr FixedString max() {
@@ -75,77 +174,172 @@ public:
     return key[0] == '\0';
   }
 
-  [[nodiscard]] std::set<FixedString> split() const {
-    std::set<FixedString> ret;
-    if (empty()) {
-      return ret;
+  [[nodiscard]] Keywords<L> split() const { //views into this string
+    return {key, len()};
+  }
+
+};
+
+class Money { //an amount in cents, so sums are exact
+  long long cents;
+
+  constexpr explicit Money(long long cents) : cents(cents) {}
+
+  static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+  }
+
+public:
+
+  Money() = default;
+
+  //digits with an optional fractional part, e.g. 12, 12.5, .5 or 12. the rest of s is ignored like stold does
+  //digits after the second decimal are rounded half up
+  explicit Money(std::string_view s) {
+    size_t i = 0;
+    int digits = 0;
+    long long whole = 0, fraction = 0;
+    for (; i < s.size() && isDigit(s[i]); i++, digits++) {
+      if (whole > (std::numeric_limits<long long>::max() / 100 - 9) / 10) {
+        throw Error("Invalid price!");
+      }
+      whole = whole * 10 + (s[i] - '0');
     }
-    char tmp[60]{};
-    int tmpLength = 0;
-    for (int i = 0; i < L && key[i] != '\0'; i++) {
-      if (key[i] != '|') {
-        tmp[tmpLength++] = key[i];
-      } else {
-        if (tmpLength == 0) {
-          throw Error("Empty keyword!");
-        }
-        if (!ret.insert(FixedString{std::string(tmp, tmpLength)}).second) {
-          throw Error("Duplicate keyword!");
+    int decimals = 0;
+    if (i < s.size() && s[i] == '.') {
+      for (i++; i < s.size() && isDigit(s[i]); i++, digits++, decimals++) {
+        if (decimals < 2) {
+          fraction = fraction * 10 + (s[i] - '0');
+        } else if (decimals == 2 && s[i] >= '5') {
+          fraction++;
         }
-        tmpLength = 0; //needn't reset tmp
       }
     }
-    if (tmpLength == 0) {
-      throw Error("Empty keyword!");
+    if (digits == 0) {
+      throw Error("Invalid price!");
     }
-    if (!ret.insert(FixedString{std::string(tmp, tmpLength)}).second) {
-      throw Error("Duplicate keyword!");
+    if (decimals == 1) {
+      fraction *= 10;
     }
-    return ret;
+    cents = whole * 100 + fraction;
+  }
+
+  static Money fromLongDouble(long double value) { //for records written before amounts were kept in cents
+    return Money(std::llround(value * 100));
+  }
+
+  auto operator<=>(const Money &rhs) const = default;
+
+  bool operator==(const Money &rhs) const = default;
+
+  friend std::ostream &operator<<(std::ostream &out, const Money &rhs) { //always with two decimals
+    char buffer[24];
+    char *p = buffer + sizeof(buffer);
+    unsigned long long value = rhs.cents < 0 ? -static_cast<unsigned long long>(rhs.cents) : rhs.cents;
+    for (int i = 0; i < 2; i++, value /= 10) {
+      *--p = static_cast<char>('0' + value % 10);
+    }
+    *--p = '.';
+    do {
+      *--p = static_cast<char>('0' + value % 10);
+      value /= 10;
+    } while (value > 0);
+    if (rhs.cents < 0) {
+      *--p = '-';
+    }
+    return out.write(p, buffer + sizeof(buffer) - p);
   }
 
+  Money operator*(int rhs) const {
+    long long ret;
+    if (__builtin_mul_overflow(cents, rhs, &ret)) {
+      throw Error("Amount too large!");
+    }
+    return Money(ret);
+  }
+
+  Money operator-(const Money &rhs) const {
+    return Money(cents - rhs.cents);
+  }
+
+  Money &operator+=(const Money &rhs) {
+    long long ret;
+    if (__builtin_add_overflow(cents, rhs.cents, &ret)) {
+      throw Error("Amount too large!");
+    }
+    cents = ret;
+    return *this;
+  }
+
+  static constexpr Money min() {
+    return Money(0);
+  }
+
+  static constexpr Money max() {
+    return Money(std::numeric_limits<long long>::max());
+  }
 };
 
-class Double {
+struct LegacyMoney { //the long double amount in records written before Money
   long double value;
 
-  explicit Double(long double value) : value(value) {}
+  [[nodiscard]] Money get() const {
+    return Money::fromLongDouble(value);
+  }
+};
+
+class Time { //seconds since the epoch in UTC
+  long long value;
+
+  static constexpr int daysIn(int year, int month) { //month from 1
+    constexpr int DAYS[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return month == 2 && leap ? 29 : DAYS[month - 1];
+  }
 
 public:
+  Time() = default;
 
-  Double() = default;
+  constexpr explicit Time(long long value) : value(value) {}
 
-  explicit Double(const std::string &s) {
-    try {
-      value = std::stold(s);
-    } catch (...) {
-      throw Error("Invalid price!");
+  explicit Time(const std::string &s) { //seconds, YYYY-MM-DD or YYYY-MM-DDTHH:MM:SS. dates are not normalized
+    if (s.find('-') == std::string::npos) {
+      try {
+        value = std::stoll(s);
+      } catch (...) {
+        throw Error("Invalid time!");
+      }
+      return;
+    }
+    std::tm tm{};
+    if (std::sscanf(s.c_str(), "%d-%d-%dT%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min,
+                    &tm.tm_sec) < 3 || tm.tm_mon < 1 || tm.tm_mon > 12 || tm.tm_mday < 1 ||
+        tm.tm_mday > daysIn(tm.tm_year, tm.tm_mon) || tm.tm_hour > 23 || tm.tm_min > 59 || tm.tm_sec > 59) {
+      throw Error("Invalid time!");
     }
+    tm.tm_year -= 1900;
+    tm.tm_mon--;
+    value = timegm(&tm);
   }
 
-  auto operator<=>(const Double &rhs) const = default;
-
-  bool operator==(const Double &rhs) const = default;
-
-  friend std::ostream &operator<<(std::ostream &out, const Double &rhs) {
-    return out << std::setiosflags(std::ios::fixed) << std::setprecision(2) << rhs.value;
+  static Time now() {
+    return Time(static_cast<long long>(std::time(nullptr)));
   }
 
-  Double operator*(int rhs) const {
-    return Double(value * rhs);
+  [[nodiscard]] long long get() const {
+    return value;
   }
 
-  Double &operator=(const Double &rhs) = default;
+  auto operator<=>(const Time &rhs) const = default;
 
-  Double &operator+=(const Double &rhs) {
-    *this = Double(value + rhs.value);
-    return *this;
+  bool operator==(const Time &rhs) const = default;
+
+  static constexpr Time min() { //also the time of records kept before timestamps
+    return Time(0);
   }
 
-  static constexpr Double min() {
-    Double ret{};
-    ret.value = 0;
-    return ret;
+  static constexpr Time max() {
+    return Time(std::numeric_limits<long long>::max());
   }
 };
 
@@ -155,13 +349,50 @@ typedef FixedString<60> String60;
 typedef FixedString<300> String300;
 
 std::string shorten(const std::string &s, int maxLen) {
-  if (s.length() <= maxLen) {
+  if (s.length() <= static_cast<size_t>(maxLen)) {
     return s;
   } else {
     return s.substr(0, maxLen - 3) + "...";
   }
 }
 
+//intersect two strictly increasing arrays into out, which shouldn't alias them. return the size of the result
+//with SSE2, blocks of four are compared all against all and the block with the smaller maximum is skipped
+int intersect(const int *a, int na, const int *b, int nb, int *out) {
+  int i = 0, j = 0, k = 0;
+#ifdef __SSE2__
+  while (i + 4 <= na && j + 4 <= nb) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + j));
+    __m128i eq = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi32(va, vb), _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+      _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+                   _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+    for (int m = 0; m < 4; m++) {
+      if (mask >> m & 1) {
+        out[k++] = a[i + m];
+      }
+    }
+    int maxA = a[i + 3], maxB = b[j + 3];
+    i += maxA <= maxB ? 4 : 0;
+    j += maxB <= maxA ? 4 : 0;
+  }
+#endif
+  while (i < na && j < nb) {
+    if (a[i] < b[j]) {
+      i++;
+    } else if (b[j] < a[i]) {
+      j++;
+    } else {
+      out[k++] = a[i];
+      i++;
+      j++;
+    }
+  }
+  return k;
+}
+
 enum Privilege {
   GUEST = 0, CUSTOMER = 1, CLERK = 3, ADMIN = 7
 };
@@ -170,14 +401,14 @@ enum BookDataID {
   ISBN_TYPE, NAME_TYPE, AUTHOR_TYPE, KEYWORD_TYPE, PRICE_TYPE
 };
 
-std::map<std::string, Privilege> privilegeMap = {
+std::map<std::string, Privilege, std::less<>> privilegeMap = {
   {"7", ADMIN},
   {"3", CLERK},
   {"1", CUSTOMER},
   {"0", GUEST}
 };
 
-std::map<std::string, BookDataID> bookDataMap = {
+std::map<std::string, BookDataID, std::less<>> bookDataMap = {
   {"ISBN",    ISBN_TYPE},
   {"name",    NAME_TYPE},
   {"author",  AUTHOR_TYPE},
@@ -186,29 +417,35 @@ std::map<std::string, BookDataID> bookDataMap = {
 };
 
 template<typename T>
-T fromString(const std::string &s) {
-  return T(s);
+T fromString(std::string_view s) {
+  if constexpr (std::is_constructible_v<T, std::string_view>) {
+    return T(s);
+  } else {
+    return T(std::string(s));
+  }
 }
 
 template<>
-int fromString(const std::string &s) {
-  try {
-    return std::stoi(s);
-  } catch (...) {
+int fromString(std::string_view s) {
+  int ret;
+  auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), ret);
+  if (ec != std::errc() || end != s.data() + s.size()) {
     throw Error("Invalid count!");
   }
+  return ret;
 }
 
 template<>
-Privilege fromString(const std::string &s) {
-  if (privilegeMap.find(s) == privilegeMap.end()) {
+Privilege fromString(std::string_view s) {
+  auto it = privilegeMap.find(s);
+  if (it == privilegeMap.end()) {
     throw Error("Invalid privilege!");
   }
-  return privilegeMap[s];
+  return it->second;
 }
 
 template<>
-String20 fromString(const std::string &s) {
+String20 fromString(std::string_view s) {
   if (s.empty()) {
     throw Error("Empty String!");
   }
@@ -216,7 +453,7 @@ String20 fromString(const std::string &s) {
 }
 
 template<>
-String30 fromString(const std::string &s) {
+String30 fromString(std::string_view s) {
   if (s.empty()) {
     throw Error("Empty String!");
   }
@@ -224,7 +461,7 @@ String30 fromString(const std::string &s) {
 }
 
 template<>
-String60 fromString(const std::string &s) {
+String60 fromString(std::string_view s) {
   if (s.empty()) {
     throw Error("Empty String!");
   }
@@ -232,48 +469,126 @@ String60 fromString(const std::string &s) {
 }
 
 template<>
-BookDataID fromString(const std::string &s) {
-  if (bookDataMap.find(s) == bookDataMap.end()) {
+BookDataID fromString(std::string_view s) {
+  auto it = bookDataMap.find(s);
+  if (it == bookDataMap.end()) {
     throw Error("Invalid type!");
   }
-  return bookDataMap[s];
+  return it->second;
+}
+
+struct CharClass { //a set of characters, built at compile time from ranges like "a-z0-9_"
+  bool has[256]{};
+
+  constexpr explicit CharClass(std::string_view ranges) {
+    for (size_t i = 0; i < ranges.size(); i++) {
+      if (i + 2 < ranges.size() && ranges[i + 1] == '-') {
+        for (int c = static_cast<unsigned char>(ranges[i]); c <= static_cast<unsigned char>(ranges[i + 2]); c++) {
+          has[c] = true;
+        }
+        i += 2;
+      } else {
+        has[static_cast<unsigned char>(ranges[i])] = true;
+      }
+    }
+  }
+
+  constexpr bool operator()(char c) const {
+    return has[static_cast<unsigned char>(c)];
+  }
+};
+
+struct Pattern { //1 to maxLength characters of a class, optionally in quotes, or a custom shape
+  CharClass chars;
+  int maxLength;
+  bool quoted = false;
+  bool (*shape)(std::string_view) = nullptr; //used instead of the class if set
+
+  //check s in a single pass and return the part without quotes. nullopt if not matched
+  [[nodiscard]] constexpr std::optional<std::string_view> match(std::string_view s) const {
+    if (quoted) {
+      if (s.size() < 2 || s.front() != '"' || s.back() != '"') {
+        return std::nullopt;
+      }
+      s = s.substr(1, s.size() - 2);
+    }
+    if (shape != nullptr) {
+      return shape(s) ? std::optional(s) : std::nullopt;
+    }
+    if (s.empty() || s.size() > static_cast<size_t>(maxLength)) {
+      return std::nullopt;
+    }
+    for (char c: s) {
+      if (!chars(c)) {
+        return std::nullopt;
+      }
+    }
+    return s;
+  }
+};
+
+constexpr CharClass VISIBLE("!-~");
+constexpr CharClass AZ("a-zA-Z0-9_");
+constexpr CharClass DIGIT("0-9");
+constexpr CharClass DIGIT_DOT("0-9.");
+constexpr CharClass NO_QUOTIENT("!#-~");
+
+constexpr Pattern merge(const CharClass &c, int len) { //shouldn't be empty
+  return {c, len};
 }
 
-const std::string VISIBLE = "[!-~]";
-const std::string AZ = "[a-zA-Z0-9_]";
-const std::string DIGIT = "[0-9]";
-const std::string DIGIT_DOT = "[0-9.]";
-const std::string NO_QUOTIENT = "[!#-~]";
+constexpr Pattern mergeWithQuotient(const CharClass &c, int len) { //shouldn't be empty
+  return {c, len, true};
+}
 
-std::regex merge(const std::string &c, int len) { //shouldn't be empty
-  return std::regex("^(" + c + "{1," + std::to_string(len) + "})$");
+constexpr Pattern options(std::string_view chars) { //one of the characters
+  return {CharClass(chars), 1};
 }
 
-std::regex mergeWithQuotient(const std::string &c, int len) { //shouldn't be empty
-  return std::regex("^\"(" + c + "{1," + std::to_string(len) + "})\"$");
+constexpr bool isTime(std::string_view s) { //up to 12 digits, YYYY-MM-DD or YYYY-MM-DDTHH:MM:SS
+  auto digits = [&s](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      if (!DIGIT(s[i])) {
+        return false;
+      }
+    }
+    return true;
+  };
+  if (s.find('-') == std::string_view::npos) {
+    return !s.empty() && s.size() <= 12 && digits(0, s.size());
+  }
+  if ((s.size() != 10 && s.size() != 19) || !digits(0, 4) || s[4] != '-' || !digits(5, 7) || s[7] != '-' ||
+      !digits(8, 10)) {
+    return false;
+  }
+  return s.size() == 10 || (s[10] == 'T' && digits(11, 13) && s[13] == ':' && digits(14, 16) && s[16] == ':' &&
+                            digits(17, 19));
 }
 
-std::regex options(const std::initializer_list<std::string> &strings) {
-  std::string pattern = "^(";
-  for (const auto &s: strings) {
-    pattern += s;
-    pattern += "|";
+//split an argument like -key=value at the first '='. false if not in this form
+constexpr bool splitArg(std::string_view s, std::string_view &key, std::string_view &value) {
+  if (s.empty() || s.front() != '-' || s.find_first_of("\r\n") != std::string_view::npos) { //as . in a regex
+    return false;
   }
-  // Remove the last '|'
-  pattern.pop_back();
-  pattern += ")$";
-  return std::regex(pattern);
+  size_t eq = s.find('=');
+  if (eq == std::string_view::npos) {
+    return false;
+  }
+  key = s.substr(1, eq - 1);
+  value = s.substr(eq + 1);
+  return true;
 }
 
-const std::regex USER_ID_PATTERN = merge(AZ, 30);
-const std::regex PASSWORD_PATTERN = merge(AZ, 30);
-const std::regex USER_NAME_PATTERN = merge(VISIBLE, 30);
-const std::regex PRIVILEGE_PATTERN = options({"1", "3", "7"}); //ban "0" as you cannot add user with privilege 0
-const std::regex ISBN_PATTERN = merge(VISIBLE, 20);
-const std::regex NAME_PATTERN = mergeWithQuotient(NO_QUOTIENT, 60);
-const std::regex AUTHOR_PATTERN = mergeWithQuotient(NO_QUOTIENT, 60);
-const std::regex KEYWORD_PATTERN = mergeWithQuotient(NO_QUOTIENT, 60);
-const std::regex COUNT_PATTERN = merge(DIGIT, 10);
-const std::regex PRICE_PATTERN = merge(DIGIT_DOT, 13);
-const std::regex ARGS_PATTERN = std::regex("^-(.*?)=(.*)$");
+constexpr Pattern USER_ID_PATTERN = merge(AZ, 30);
+constexpr Pattern PASSWORD_PATTERN = merge(AZ, 30);
+constexpr Pattern USER_NAME_PATTERN = merge(VISIBLE, 30);
+constexpr Pattern PRIVILEGE_PATTERN = options("137"); //ban "0" as you cannot add user with privilege 0
+constexpr Pattern ISBN_PATTERN = merge(VISIBLE, 20);
+constexpr Pattern NAME_PATTERN = mergeWithQuotient(NO_QUOTIENT, 60);
+constexpr Pattern AUTHOR_PATTERN = mergeWithQuotient(NO_QUOTIENT, 60);
+constexpr Pattern KEYWORD_PATTERN = mergeWithQuotient(NO_QUOTIENT, 60);
+constexpr Pattern COUNT_PATTERN = merge(DIGIT, 10);
+constexpr Pattern PRICE_PATTERN = merge(DIGIT_DOT, 13);
+constexpr Pattern TIME_PATTERN{DIGIT, 19, false, isTime};
+
 #endif //BOOKSTORE_DATA_TYPES_HPP
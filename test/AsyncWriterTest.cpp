@@ -0,0 +1,32 @@
+//
+// Created by zjx on 2024/1/20.
+//
+//events pass through a small ring in order, flush waits for them, and the destructor drains the rest
+#include <vector>
+#include "Check.hpp"
+#include "../src/AsyncWriter.hpp"
+
+int main() {
+  std::vector<int> consumed; //only touched by the writer thread until it is flushed or destroyed
+  {
+    AsyncWriter<int, 8> writer([&consumed](int &x) {
+      consumed.push_back(x);
+    });
+    writer.flush(); //nothing pushed yet
+    CHECK(consumed.empty());
+    for (int i = 0; i < 100000; i++) { //far more than the ring holds, so the producer waits for the thread
+      writer.push(int(i));
+    }
+    writer.flush();
+    bool inOrder = static_cast<int>(consumed.size()) == 100000;
+    for (int i = 0; inOrder && i < 100000; i++) {
+      inOrder = consumed[i] == i;
+    }
+    CHECK(inOrder);
+    for (int i = 0; i < 5; i++) { //left for the destructor
+      writer.push(int(-i));
+    }
+  }
+  CHECK(consumed.size() == 100005 && consumed.back() == -4);
+  return failures;
+}
@@ -0,0 +1,43 @@
+//
+// Created by zjx on 2024/1/20.
+//
+
+#ifndef BOOKSTORE_CHECK_HPP
+#define BOOKSTORE_CHECK_HPP
+
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include "../src/Error.hpp"
+
+//a test is a program returning the number of failed checks, run by ctest in a directory of its own
+
+int failures = 0;
+
+void check(bool ok, const char *what, int line) { //report a failed check without stopping the test
+  if (!ok) {
+    std::cerr << "line " << line << ": " << what << '\n';
+    failures++;
+  }
+}
+
+#define CHECK(cond) check(cond, #cond, __LINE__)
+
+template<class F>
+void checkThrows(F &&f, const std::string &message, int line) { //f should throw an Error with message
+  try {
+    f();
+  } catch (Error &ex) {
+    check(ex.getMessage() == message, ("throws " + message + ", not " + ex.getMessage()).c_str(), line);
+    return;
+  }
+  check(false, ("throws " + message).c_str(), line);
+}
+
+#define CHECK_THROWS(expr, message) checkThrows([&]() { (void) (expr); }, message, __LINE__)
+
+void removeStorage(const std::string &name) { //start from a missing file, as left by an earlier run
+  std::filesystem::remove("storage/" + name + ".dat");
+}
+
+#endif //BOOKSTORE_CHECK_HPP
@@ -0,0 +1,148 @@
+//
+// Created by zjx on 2024/1/20.
+//
+//compare the ways of comparing, splitting and hashing FixedString, and the cost of hashing against a lookup
+//run from an empty directory, as the lookups create storage/bench.hash.dat
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "../src/Utils.hpp"
+#include "../src/PersistentHash.hpp"
+
+std::mt19937 rng(2024);
+
+template<int L>
+FixedString<L> randomString(const std::string &prefix, int len) {
+  std::string s = prefix;
+  while (static_cast<int>(s.size()) < len) {
+    s.push_back(static_cast<char>('!' + rng() % 90));
+  }
+  return FixedString<L>(s);
+}
+
+template<class F>
+double millis(F &&f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+long long sink = 0; //results are added here so the loops are not optimized away
+
+template<int L>
+void benchCompare(const char *title, const std::string &prefix) { //20 rounds of lower_bound over 200k sorted keys
+  std::vector<FixedString<L>> keys;
+  for (int i = 0; i < 200000; i++) {
+    keys.push_back(randomString<L>(prefix, L - static_cast<int>(rng() % 8)));
+  }
+  std::sort(keys.begin(), keys.end());
+  std::vector<FixedString<L>> queries(keys);
+  std::shuffle(queries.begin(), queries.end(), rng);
+  auto run = [&](auto less) {
+    return millis([&]() {
+      for (int round = 0; round < 20; round++) {
+        for (const FixedString<L> &q: queries) {
+          sink += std::lower_bound(keys.begin(), keys.end(), q, less) - keys.begin();
+        }
+      }
+    });
+  };
+  double byStrncmp = run([](const FixedString<L> &a, const FixedString<L> &b) {
+    return std::strncmp(a.begin(), b.begin(), L) < 0;
+  });
+  double byMemcmp = run([](const FixedString<L> &a, const FixedString<L> &b) {
+    return a < b;
+  });
+  std::cout << title << "\tstrncmp " << byStrncmp << " ms\tmemcmp " << byMemcmp << " ms\n";
+}
+
+void benchSplit() { //1M splits of a keyword list, building a set of strings as split() did before against the views
+  FixedString<60> s("fiction|science|space|robots|classic|award");
+  double bySet = millis([&]() {
+    for (int round = 0; round < 1000000; round++) {
+      std::set<FixedString<60>> keywords;
+      char tmp[60]{};
+      int tmpLength = 0;
+      for (int i = 0, n = s.len(); i <= n; i++) {
+        if (i < n && s.begin()[i] != '|') {
+          tmp[tmpLength++] = s.begin()[i];
+        } else {
+          keywords.insert(FixedString<60>{std::string(tmp, tmpLength)});
+          tmpLength = 0;
+        }
+      }
+      sink += static_cast<long long>(keywords.size());
+    }
+  });
+  double byViews = millis([&]() {
+    for (int round = 0; round < 1000000; round++) {
+      for (std::string_view keyword: s.split()) {
+        sink += static_cast<long long>(keyword.size());
+      }
+    }
+  });
+  std::cout << "split\tstd::set " << bySet << " ms\tmemchr and views " << byViews << " ms\n";
+}
+
+struct Value {
+  int x;
+
+  static constexpr Value min() {
+    return Value{-1};
+  }
+};
+
+void benchHash() { //per call, hashing a key against looking it up in a table whose pages are all cached
+  std::vector<String20> keys;
+  for (int i = 0; i < 100000; i++) {
+    keys.push_back(randomString<20>("978-", 17));
+  }
+  uint64_t cached = 0;
+  double hashing = millis([&]() {
+    for (int round = 0; round < 20; round++) {
+      for (const String20 &k: keys) {
+        sink += static_cast<long long>(k.hash());
+      }
+    }
+  });
+  double reading = millis([&]() {
+    for (int round = 0; round < 20; round++) {
+      for (size_t i = 0; i < keys.size(); i++) {
+        cached += i;
+        sink += static_cast<long long>(cached);
+      }
+    }
+  });
+  std::filesystem::remove("storage/bench.hash.dat");
+  double lookup;
+  {
+    PersistentHashMap<String20, Value, 128, 1280> map("bench.hash");
+    for (int i = 0; i < static_cast<int>(keys.size()); i++) {
+      map.put(keys[i], Value{i});
+    }
+    lookup = millis([&]() {
+      for (int round = 0; round < 20; round++) {
+        for (const String20 &k: keys) {
+          sink += map.get(k).x;
+        }
+      }
+    });
+  }
+  std::filesystem::remove("storage/bench.hash.dat");
+  double calls = 20.0 * static_cast<double>(keys.size());
+  std::cout << "hash\tString20 " << hashing * 1e6 / calls << " ns\tcached " << reading * 1e6 / calls
+            << " ns\tget " << lookup * 1e6 / calls << " ns\n";
+}
+
+int main() {
+  benchCompare<20>("String20", "");
+  benchCompare<60>("String60", "a common prefix of the names ");
+  benchSplit();
+  benchHash();
+  std::cerr << sink << '\n';
+}
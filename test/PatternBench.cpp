@@ -0,0 +1,60 @@
+//
+// Created by zjx on 2024/1/20.
+//
+//time std::regex against Pattern on the arguments of typical commands, checking that both accept the same ones
+#include <chrono>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+#include "../src/Utils.hpp"
+
+struct Case {
+  const char *title;
+  const Pattern &pattern;
+  std::regex regex;
+  std::vector<std::string> args;
+};
+
+template<class F>
+double millis(F &&f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  std::vector<Case> cases;
+  cases.push_back({"userID", USER_ID_PATTERN, std::regex("[a-zA-Z0-9_]{1,30}"),
+                   {"root", "employee_007", "a-b", "", std::string(31, 'x')}});
+  cases.push_back({"ISBN", ISBN_PATTERN, std::regex("[!-~]{1,20}"),
+                   {"978-7-111-54742-6", "B000123", "isbn with space", std::string(21, '9')}});
+  cases.push_back({"name", NAME_PATTERN, std::regex("\"[!#-~]{1,60}\""),
+                   {"\"The_Art_of_Computer_Programming\"", "\"x\"", "no_quotes", "\"\"", "\"a\"b\""}});
+  cases.push_back({"price", PRICE_PATTERN, std::regex("[0-9.]{1,13}"), {"12.50", "0.01", "-1", "12345678901234"}});
+  long long sink = 0;
+  for (Case &c: cases) {
+    for (const std::string &arg: c.args) {
+      if (c.pattern.match(arg).has_value() != std::regex_match(arg, c.regex)) {
+        std::cerr << c.title << " disagrees on " << arg << '\n';
+        return 1;
+      }
+    }
+    double byRegex = millis([&]() {
+      for (int round = 0; round < 100000; round++) {
+        for (const std::string &arg: c.args) {
+          sink += std::regex_match(arg, c.regex);
+        }
+      }
+    });
+    double byPattern = millis([&]() {
+      for (int round = 0; round < 100000; round++) {
+        for (const std::string &arg: c.args) {
+          sink += c.pattern.match(arg).has_value();
+        }
+      }
+    });
+    std::cout << c.title << "\tregex " << byRegex << " ms\tPattern " << byPattern << " ms\n";
+  }
+  std::cerr << sink << '\n';
+}
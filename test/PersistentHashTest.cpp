@@ -0,0 +1,80 @@
+//
+// Created by zjx on 2024/1/20.
+//
+//the extendible hash table against std::map, with buckets small enough that the directory doubles many times
+#include <map>
+#include <random>
+#include "Check.hpp"
+#include "../src/PersistentHash.hpp"
+
+struct Value {
+  int x;
+
+  static constexpr Value min() {
+    return Value{-1};
+  }
+};
+
+typedef PersistentHashMap<int, Value, 8, 64> Map;
+
+bool same(Map &map, const std::map<int, int> &expected) { //every key, and a missing key for each
+  int size = 0;
+  bool ok = true;
+  map.iterate([&size](const int &, const Value &) {
+    size++;
+  });
+  for (auto [k, v]: expected) {
+    ok &= map.get(k).x == v && map.get(k ^ 1 << 30).x == -1; //keys stay far from 2^30
+  }
+  return ok && size == static_cast<int>(expected.size());
+}
+
+int main() {
+  removeStorage("hash.test");
+  std::mt19937 rng(2024);
+  std::map<int, int> expected;
+  int depth, buckets;
+  {
+    Map map("hash.test");
+    CHECK(map.depth() == 0 && map.buckets() == 1);
+    for (int i = 0; i < 5000; i++) { //splits buckets and doubles the directory
+      int k = static_cast<int>(rng() % 1000000);
+      CHECK(map.put(k, Value{i}) == expected.emplace(k, i).second);
+    }
+    CHECK(map.depth() > 5 && map.buckets() > 5000 / 8);
+    CHECK(same(map, expected));
+    CHECK(map.stats().negatives > 0); //most missing keys are ruled out by the filters
+    auto it = expected.begin();
+    for (int i = 0; i < 2000; i++, it = expected.erase(it)) {
+      CHECK(map.remove(it->first));
+    }
+    CHECK(!map.remove(-1));
+    map.upsert(it->first, Value{-2});
+    it->second = -2;
+    CHECK(map.update(it->first, [](Value &v) {
+      v.x--;
+    }));
+    it->second--;
+    CHECK(same(map, expected));
+    depth = map.depth();
+    buckets = map.buckets();
+  }
+  {
+    Map map("hash.test"); //reopened with the filters saved on close
+    CHECK(map.depth() == depth && map.buckets() == buckets);
+    CHECK(same(map, expected));
+    CHECK(map.compact() > 0); //the buckets emptied by removes are given back
+    CHECK(map.buckets() < buckets);
+    CHECK(same(map, expected));
+    for (int k = -1; k > -1000; k--) { //still splits after being rebuilt
+      map.put(k * 1000, Value{k});
+      expected[k * 1000] = k;
+    }
+    CHECK(same(map, expected));
+  }
+  {
+    Map map("hash.test");
+    CHECK(same(map, expected));
+  }
+  return failures;
+}
@@ -0,0 +1,73 @@
+//
+// Created by zjx on 2024/1/20.
+//
+//the segmented log against a vector of records, across segments and with records longer than a segment
+#include <string>
+#include <vector>
+#include "Check.hpp"
+#include "../src/PersistentLog.hpp"
+
+struct Record {
+  long long time;
+  std::string text;
+};
+
+std::vector<std::string> between(const std::vector<Record> &records, long long since, long long until) {
+  std::vector<std::string> ret;
+  for (const Record &r: records) {
+    if (r.time >= since && r.time < until) {
+      ret.push_back(r.text);
+    }
+  }
+  return ret;
+}
+
+std::vector<std::string> read(PersistentLog &log, long long since, long long until) {
+  std::vector<std::string> ret;
+  log.iterateBetween(since, until, [&ret](std::string_view s) {
+    ret.emplace_back(s);
+  });
+  return ret;
+}
+
+std::vector<std::string> readAll(PersistentLog &log) {
+  std::vector<std::string> ret;
+  log.iterateFromBegin([&ret](std::string_view s) {
+    ret.emplace_back(s);
+  });
+  return ret;
+}
+
+int main() {
+  removeStorage("log.test");
+  std::vector<Record> records;
+  {
+    PersistentLog log("log.test");
+    CHECK(readAll(log).empty());
+    CHECK(read(log, 0, 100).empty());
+    for (int i = 0; i < 5000; i++) { //about 40 bytes each, so many segments are filled
+      records.push_back({i / 10, "record " + std::to_string(i) + std::string(i % 50, '.')});
+      log.push_back(records.back().time, records.back().text);
+    }
+    records.push_back({600, std::string(100000, 'x') + "end"}); //split over four segments
+    log.push_back(600, records.back().text);
+    records.push_back({600, "after a long record"});
+    log.push_back(10, records.back().text); //raised to the time of the last record
+    records.push_back({700, ""});
+    log.push_back(700, "");
+    CHECK(log.size() == static_cast<int>(records.size()));
+    CHECK(readAll(log) == between(records, LLONG_MIN, LLONG_MAX));
+  }
+  PersistentLog log("log.test"); //reopened
+  CHECK(log.size() == static_cast<int>(records.size()));
+  CHECK(readAll(log) == between(records, LLONG_MIN, LLONG_MAX));
+  long long ranges[][2] = {{0, 1}, {0, 500}, {123, 124}, {250, 251}, {499, 600}, {499, 601}, {600, 601}, {600, 800},
+                           {-5, 0}, {800, 900}, {300, 200}};
+  for (auto [since, until]: ranges) {
+    if (read(log, since, until) != between(records, since, until)) {
+      std::cerr << "[" << since << ", " << until << ")\n";
+      CHECK(read(log, since, until) == between(records, since, until));
+    }
+  }
+  return failures;
+}
@@ -0,0 +1,77 @@
+//
+// Created by zjx on 2024/1/20.
+//
+//the B+ tree against std::set, with leaves small enough that inserts split and erases merge at every level
+#include <random>
+#include <set>
+#include <vector>
+#include "Check.hpp"
+#include "../src/PersistentSet.hpp"
+
+typedef PersistentSet<int, 8> Set;
+
+bool same(Set &set, const std::set<int> &expected) { //all elements in order, and a range in the middle
+  std::vector<int> all = set.search(INT32_MIN, INT32_MAX);
+  if (all != std::vector<int>(expected.begin(), expected.end())) {
+    return false;
+  }
+  std::vector<int> middle = set.search(1000, 2000);
+  return middle == std::vector<int>(expected.lower_bound(1000), expected.upper_bound(2000));
+}
+
+int main() {
+  removeStorage("set.test");
+  std::mt19937 rng(2024);
+  std::set<int> expected;
+  {
+    Set set("set.test");
+    CHECK(set.empty());
+    CHECK(!set.erase(1));
+    for (int i = 0; i < 20000; i++) { //grow with random inserts, so leaves and internal nodes split
+      int x = static_cast<int>(rng() % 5000);
+      CHECK(set.insert(x) == expected.insert(x).second);
+    }
+    CHECK(same(set, expected));
+    for (int i = 0; i < 20000; i++) { //shrink with random erases, so nodes merge or borrow from siblings
+      int x = static_cast<int>(rng() % 5000);
+      CHECK(set.erase(x) == (expected.erase(x) > 0));
+    }
+    CHECK(same(set, expected));
+    for (int x = 0; x < 5000; x++) {
+      if (set.contains(x) != expected.contains(x)) {
+        CHECK(set.contains(x) == expected.contains(x));
+        break;
+      }
+    }
+  }
+  {
+    Set set("set.test"); //reopened
+    CHECK(same(set, expected));
+    for (int x = 0; x < 5000; x += 3) { //leave a sparse tree behind
+      set.insert(x);
+      expected.insert(x);
+    }
+    for (int x = 0; x < 5000; x++) {
+      if (x % 3 != 0 && x % 10 != 0) {
+        set.erase(x);
+        expected.erase(x);
+      }
+    }
+    CHECK(set.compact() > 0);
+    CHECK(same(set, expected));
+    CHECK(set.compact() == 0); //already dense
+    set.insert(-1); //still a valid tree after being rebuilt
+    expected.insert(-1);
+    CHECK(same(set, expected));
+  }
+  {
+    Set set("set.test");
+    CHECK(same(set, expected));
+    for (int x: expected) {
+      set.erase(x);
+    }
+    CHECK(set.empty());
+    CHECK(set.search(INT32_MIN, INT32_MAX).empty());
+  }
+  return failures;
+}
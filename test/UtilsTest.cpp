@@ -0,0 +1,133 @@
+//
+// Created by zjx on 2024/1/20.
+//
+//argument patterns, posting list intersection, Money, Keywords and Time
+#include <random>
+#include <sstream>
+#include <vector>
+#include "Check.hpp"
+#include "../src/Utils.hpp"
+
+std::string print(const Money &m) {
+  std::stringstream ss;
+  ss << m;
+  return ss.str();
+}
+
+bool accepts(const Pattern &pattern, const std::string &s) {
+  return pattern.match(s).has_value();
+}
+
+void testPatterns() {
+  CHECK(USER_ID_PATTERN.match("root_1") == "root_1");
+  CHECK(!accepts(USER_ID_PATTERN, ""));
+  CHECK(!accepts(USER_ID_PATTERN, "a-b"));
+  CHECK(accepts(USER_ID_PATTERN, std::string(30, 'a')));
+  CHECK(!accepts(USER_ID_PATTERN, std::string(31, 'a')));
+  CHECK(accepts(USER_NAME_PATTERN, "~!@#"));
+  CHECK(!accepts(USER_NAME_PATTERN, "a\tb"));
+  CHECK(NAME_PATTERN.match("\"book\"") == "book"); //without the quotes
+  CHECK(!accepts(NAME_PATTERN, "book"));
+  CHECK(!accepts(NAME_PATTERN, "\"\""));
+  CHECK(!accepts(NAME_PATTERN, "\""));
+  CHECK(!accepts(NAME_PATTERN, "\"bo\"ok\""));
+  CHECK(accepts(NAME_PATTERN, "\"" + std::string(60, 'a') + "\""));
+  CHECK(!accepts(NAME_PATTERN, "\"" + std::string(61, 'a') + "\""));
+  CHECK(accepts(PRIVILEGE_PATTERN, "7") && accepts(PRIVILEGE_PATTERN, "1"));
+  CHECK(!accepts(PRIVILEGE_PATTERN, "0") && !accepts(PRIVILEGE_PATTERN, "2") && !accepts(PRIVILEGE_PATTERN, "11"));
+  CHECK(accepts(PRICE_PATTERN, "12.50") && !accepts(PRICE_PATTERN, "-1"));
+  CHECK(!accepts(PRICE_PATTERN, "12345678901234"));
+  CHECK(accepts(TIME_PATTERN, "1700000000") && !accepts(TIME_PATTERN, "1234567890123"));
+  CHECK(accepts(TIME_PATTERN, "2024-01-20") && accepts(TIME_PATTERN, "2024-01-20T12:00:00"));
+  CHECK(!accepts(TIME_PATTERN, "2024-1-20") && !accepts(TIME_PATTERN, "2024-01-20 12:00:00"));
+  CHECK(!accepts(TIME_PATTERN, ""));
+}
+
+void testIntersect() { //against std::set_intersection, at sizes around the blocks of four
+  std::mt19937 rng(2024);
+  for (int round = 0; round < 1000; round++) {
+    std::vector<int> a, b;
+    int na = static_cast<int>(rng() % 40), nb = static_cast<int>(rng() % 40);
+    int range = 1 + static_cast<int>(rng() % 100);
+    for (int x = 0; x < range; x++) {
+      if (static_cast<int>(rng() % range) < na) {
+        a.push_back(x);
+      }
+      if (static_cast<int>(rng() % range) < nb) {
+        b.push_back(x);
+      }
+    }
+    std::vector<int> expected, out(std::min(a.size(), b.size()) + 1);
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+    out.resize(intersect(a.data(), static_cast<int>(a.size()), b.data(), static_cast<int>(b.size()), out.data()));
+    if (out != expected) {
+      CHECK(out == expected);
+      return;
+    }
+  }
+}
+
+void testMoney() {
+  CHECK(print(Money("12")) == "12.00");
+  CHECK(print(Money("12.5")) == "12.50");
+  CHECK(print(Money(".5")) == "0.50");
+  CHECK(print(Money("12.")) == "12.00");
+  CHECK(print(Money("0.01")) == "0.01");
+  CHECK(print(Money("1.004")) == "1.00"); //rounded half up at the third decimal
+  CHECK(print(Money("1.005")) == "1.01");
+  CHECK(print(Money("0.995")) == "1.00");
+  CHECK(print(Money("9.9999")) == "10.00");
+  CHECK(print(Money("1.2.3")) == "1.20"); //the rest is ignored
+  CHECK(print(Money("1.5") * 3) == "4.50");
+  CHECK(print(Money("1") - Money("2.5")) == "-1.50");
+  CHECK(Money("0.10") == Money(".1"));
+  CHECK(Money("2") < Money("10"));
+  CHECK_THROWS(Money(""), "Invalid price!");
+  CHECK_THROWS(Money("."), "Invalid price!");
+  CHECK_THROWS(Money("abc"), "Invalid price!");
+  CHECK_THROWS(Money("99999999999999999999"), "Invalid price!");
+  CHECK_THROWS(Money("90000000000000000") * 10, "Amount too large!");
+  CHECK_THROWS(Money::max() += Money("0.01"), "Amount too large!");
+}
+
+void testKeywords() {
+  String60 s("b|c|a");
+  Keywords<60> keywords = s.split();
+  CHECK(keywords.size() == 3);
+  CHECK(keywords[0] == "a" && keywords[1] == "b" && keywords[2] == "c"); //sorted
+  CHECK(keywords.contains("b") && !keywords.contains("d") && !keywords.contains("b|c"));
+  CHECK(String60("").split().size() == 0);
+  CHECK(String60("only").split().size() == 1);
+  CHECK_THROWS(String60("a||b").split(), "Empty keyword!");
+  CHECK_THROWS(String60("|a").split(), "Empty keyword!");
+  CHECK_THROWS(String60("a|").split(), "Empty keyword!");
+  CHECK_THROWS(String60("|").split(), "Empty keyword!");
+  CHECK_THROWS(String60("a|b|a").split(), "Duplicate keyword!");
+  CHECK_THROWS(String60("a|a|").split(), "Duplicate keyword!"); //a repeat is reported before an empty keyword
+  CHECK_THROWS(String60(std::string(61, 'a')), "String too long, this should never happen!");
+}
+
+void testTime() {
+  CHECK(Time("0") == Time::min());
+  CHECK(Time("86400").get() == 86400);
+  CHECK(Time("1970-01-02").get() == 86400);
+  CHECK(Time("1970-01-01T01:00:01").get() == 3601);
+  CHECK(Time("2024-02-29") < Time("2024-03-01"));
+  CHECK(Time("2000-02-29").get() == 951782400);
+  CHECK_THROWS(Time("2024-02-30"), "Invalid time!");
+  CHECK_THROWS(Time("2023-02-29"), "Invalid time!");
+  CHECK_THROWS(Time("1900-02-29"), "Invalid time!");
+  CHECK_THROWS(Time("2024-04-31"), "Invalid time!");
+  CHECK_THROWS(Time("2024-13-01"), "Invalid time!");
+  CHECK_THROWS(Time("2024-01-01T24:00:00"), "Invalid time!");
+  CHECK_THROWS(Time("99999999999999999999"), "Invalid time!");
+}
+
+int main() {
+  testPatterns();
+  testIntersect();
+  testMoney();
+  testKeywords();
+  testTime();
+  return failures;
+}